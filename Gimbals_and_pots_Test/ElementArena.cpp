@@ -0,0 +1,54 @@
+#include "ElementArena.h"
+
+/************************************************************************/
+/* ElementArena implementation                                          */
+/************************************************************************/
+
+// Free blocks store the index of the next free one in their first byte
+ElementArena::ElementArena(uint8_t* n_storage, uint16_t n_block_size, uint8_t n_block_nb) : storage(n_storage),
+block_size(n_block_size), block_nb(n_block_nb), free_head(0), free_nb(n_block_nb)
+{
+	for (uint8_t i = 0; i < block_nb; i++) storage[i * block_size] = i + 1;
+}
+
+void* ElementArena::allocate(uint16_t size)
+{
+	if (free_nb == 0 || size > block_size) return NULL;
+	uint8_t* block = storage + free_head * block_size;
+	free_head = block[0];
+	free_nb--;
+	return block;
+}
+
+void ElementArena::release(void* block)
+{
+	if (!owns(block)) return;
+	uint8_t index = ((uint8_t*) block - storage) / block_size;
+	storage[index * block_size] = free_head;
+	free_head = index;
+	free_nb++;
+}
+
+uint8_t ElementArena::owns(void* block)
+{
+	uint8_t* address = (uint8_t*) block;
+	if (address < storage || address >= storage + block_nb * block_size) return 0;
+	return (address - storage) % block_size == 0;
+}
+
+uint8_t ElementArena::get_block_nb() {return block_nb;}
+uint8_t ElementArena::get_free_nb() {return free_nb;}
+uint16_t ElementArena::get_block_size() {return block_size;}
+
+/************************************************************************/
+/* TransformPipeline elements drawn from an arena                       */
+/************************************************************************/
+
+uint8_t TransformPipeline::destroy_element(TransformElement* element, ElementArena* arena)
+{
+	int position = find_element(element);
+	if (position < 0) return 0;
+	remove_element(position);
+	if (arena != NULL) arena->release(element);
+	return 1;
+}
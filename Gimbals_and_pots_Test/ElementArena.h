@@ -0,0 +1,77 @@
+/*
+Version |   date   |  description
+V 0.1   17/10/2026  Fixed size arena of TransformElements, for the stages added to a pipeline at runtime
+*/
+
+#ifndef ELEMENT_ARENA
+#define ELEMENT_ARENA
+
+#include <stdint.h>
+#include <stddef.h>
+#include "TransformPipeline.h"
+
+#ifdef __AVR__
+// avr-libc doesn't ship <new> : placement new is the only one needed
+inline void* operator new(size_t, void* block) {return block;}
+#else
+#include <new>
+#endif
+
+// Blocks of the same size, linked in a free list : allocate() and release() are O(1), and a released block
+// can be used again by any element class which fits in it. No heap, no fragmentation.
+// Elements own no resource : releasing a block doesn't call any destructor.
+// The storage is given by ElementPool below, which sizes it at compile time.
+class ElementArena
+{
+	public:
+		// Placement-constructs an Element in a free block, NULL if the arena is full or if the Element doesn't fit
+		template<typename Element> Element* create()
+		{
+			void* block = allocate(sizeof(Element));
+			if (block == NULL) return NULL;
+			return new(block) Element();
+		}
+		void* allocate(uint16_t size);	// NULL if the arena is full or if size is bigger than a block
+		void release(void* block);	// Ignores the blocks which don't belong to this arena
+		uint8_t owns(void* block);
+		uint8_t get_block_nb();
+		uint8_t get_free_nb();
+		uint16_t get_block_size();
+	protected:
+		ElementArena(uint8_t* n_storage, uint16_t n_block_size, uint8_t n_block_nb);
+	private:
+		uint8_t* storage;
+		uint16_t block_size;
+		uint8_t block_nb;
+		uint8_t free_head;	// Index of the first free block, block_nb when the arena is full
+		uint8_t free_nb;
+};
+
+// Arena of Blocks blocks of BlockSize bytes (rounded up to the alignment of a pointer), e.g. :
+//  ElementPool<sizeof(MedianFilter<5>), 4> pool;
+//  pot.add_stage<MedianFilter<5> >(&pool, 0);	// Median in front of the filter of this sensor only
+template<uint16_t BlockSize, uint8_t Blocks>
+class ElementPool : public ElementArena
+{
+	public:
+		ElementPool() : ElementArena(blocks[0].bytes, sizeof(Block), Blocks) {}
+	private:
+		union Block
+		{
+			uint8_t bytes[BlockSize];
+			void* align_pointer;	// Alignment of the elements (vptr, pointers, int32_t)
+			int32_t align_int;
+		};
+		Block blocks[Blocks];	// Not initialized : ElementArena() has already linked the free list in it
+};
+
+template<typename Element> Element* TransformPipeline::create_element(ElementArena* arena, uint8_t position)
+{
+	if (arena == NULL || tot_elements >= max_pipeline_size) return NULL;
+	Element* element = arena->create<Element>();
+	if (element == NULL) return NULL;
+	insert_element(element, position);
+	return element;
+}
+
+#endif
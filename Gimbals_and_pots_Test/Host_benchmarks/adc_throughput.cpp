@@ -0,0 +1,137 @@
+/*
+ * adc_throughput
+ * Host program (see Host_simulation/Readme.md) measuring the asynchronous Adc on the simulated Atmega328P ADC.
+ * A set of potentiometers keep on sending requests from the main loop, as in Pots_and_Axis_implementation.cpp.
+ * Reports :
+ *  -> conversions/sec and ADC utilization
+ *  -> pending requests list occupancy (average and max)
+ *  -> latency of Adc::add_request -> conversion_complete (queueing + conversion)
+ *  -> latency of conversion_complete -> AnalogSensor::update_result (main loop pickup)
+ *
+ * Usage : adc_throughput [sensor_nb] [main_loop_cycles] [simulated_seconds]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "adc_tools.h"
+#include "Sensors.h"
+
+#define MAX_SENSORS 8
+#define LATENCY_FIFO_SIZE 8		// Must be >= max requests per sensor
+
+Adc adc;
+Potentiometer pots[MAX_SENSORS];
+uint8_t sensor_nb = 3;
+
+// Latency tracking of one sensor
+struct LatencyTracker {
+	uint64_t request_time[LATENCY_FIFO_SIZE];	// Time stamps of accepted requests, oldest first
+	uint8_t head;
+	uint8_t count;
+	uint64_t completion_time;	// Time stamp of the last conversion not yet picked up by update_result (newest sample)
+	uint8_t result_pending;
+	uint64_t conv_latency_sum, conv_latency_max;
+	uint64_t pickup_latency_sum, pickup_latency_max;
+	uint32_t conv_nb, pickup_nb;
+};
+LatencyTracker trackers[MAX_SENSORS];
+
+static uint8_t sensor_index(AnalogSensor* sensor)
+{
+	for(uint8_t i = 0; i < sensor_nb; i++) if(&pots[i] == sensor) return i;
+	return MAX_SENSORS;
+}
+
+ISR(ADC_vect){
+	uint8_t index = sensor_index(adc.get_current_sensor_id());
+	adc.handle_conversion();
+	if(index >= MAX_SENSORS) return;
+	LatencyTracker* t = &trackers[index];
+	uint64_t now = sim_adc.get_cycles();
+	if(t->count){
+		uint64_t latency = now - t->request_time[t->head];
+		t->conv_latency_sum += latency;
+		if(latency > t->conv_latency_max) t->conv_latency_max = latency;
+		t->head = (t->head + 1) % LATENCY_FIFO_SIZE;
+		t->count--;
+		t->conv_nb++;
+	}
+	t->completion_time = now;
+	t->result_pending = 1;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t loop_cycles = 400;		// Simulated cost of one main loop pass
+	double duration = 1.0;			// Simulated seconds
+	if(argc > 1) sensor_nb = atoi(argv[1]);
+	if(argc > 2) loop_cycles = atoi(argv[2]);
+	if(argc > 3) duration = atof(argv[3]);
+	if(sensor_nb == 0 || sensor_nb > MAX_SENSORS) sensor_nb = 3;
+
+	sim_adc.set_isr_cycles(60);
+	for(uint8_t i = 0; i < sensor_nb; i++){
+		pots[i].set_adc_mux(i);
+		sim_adc.set_input(i, 100 * (i + 1));
+	}
+	adc.initialize();
+	sei();
+
+	uint64_t end = (uint64_t)(duration * F_CPU);
+	uint64_t occupancy_sum = 0, loop_nb = 0;
+	uint8_t occupancy_max = 0;
+	while(sim_adc.get_cycles() < end)
+	{
+		for(uint8_t i = 0; i < sensor_nb; i++)
+		{
+			uint8_t before = pots[i].get_adc_handler_ptr()->get_tot_req_nb();
+			pots[i].send_adc_request(&adc);
+			if(pots[i].get_adc_handler_ptr()->get_tot_req_nb() != before){
+				LatencyTracker* t = &trackers[i];
+				t->request_time[(t->head + t->count) % LATENCY_FIFO_SIZE] = sim_adc.get_cycles();
+				t->count++;
+			}
+		}
+		for(uint8_t i = 0; i < sensor_nb; i++)
+		{
+			LatencyTracker* t = &trackers[i];
+			pots[i].update_result();
+			if(t->result_pending){
+				uint64_t latency = sim_adc.get_cycles() - t->completion_time;
+				t->pickup_latency_sum += latency;
+				if(latency > t->pickup_latency_max) t->pickup_latency_max = latency;
+				t->pickup_nb++;
+				t->result_pending = 0;
+			}
+		}
+		uint8_t occupancy = adc.get_pending_req_nb();
+		occupancy_sum += occupancy;
+		if(occupancy > occupancy_max) occupancy_max = occupancy;
+		loop_nb++;
+		sim_adc.run(loop_cycles);
+	}
+
+	double seconds = sim_adc.cycles_to_seconds(sim_adc.get_cycles());
+	double us_per_cycle = 1e6 / F_CPU;
+	printf("Simulated time        : %.3f s (F_CPU = %lu Hz, prescaler = %u, main loop = %u cycles)\n",
+		   seconds, (unsigned long) F_CPU, sim_adc.get_prescaler(), loop_cycles);
+	printf("Conversions           : %u (%.0f conv/s, ADC busy %.1f %%)\n", sim_adc.get_conversion_nb(),
+		   sim_adc.get_conversion_nb() / seconds, 100.0 * sim_adc.get_busy_cycles() / sim_adc.get_cycles());
+	printf("Queue occupancy       : avg %.2f / max %u (ADC_REQUEST_SIZE = %d)\n",
+		   (double) occupancy_sum / loop_nb, occupancy_max, ADC_REQUEST_SIZE);
+	printf("sensor | samples/s | request->conversion us (avg/max) | conversion->update us (avg/max) | lost\n");
+	for(uint8_t i = 0; i < sensor_nb; i++)
+	{
+		LatencyTracker* t = &trackers[i];
+		printf("%6u | %9.0f | %14.1f / %-15.1f | %14.1f / %-14.1f | %u\n", i, t->conv_nb / seconds,
+			   t->conv_nb ? us_per_cycle * t->conv_latency_sum / t->conv_nb : 0.0, us_per_cycle * t->conv_latency_max,
+			   t->pickup_nb ? us_per_cycle * t->pickup_latency_sum / t->pickup_nb : 0.0, us_per_cycle * t->pickup_latency_max,
+			   pots[i].get_lost_samples());
+	}
+	return 0;
+}
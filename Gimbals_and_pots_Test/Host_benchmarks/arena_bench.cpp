@@ -0,0 +1,94 @@
+/*
+ * arena_bench
+ * Host program (see Host_simulation/Readme.md) checking the stages drawn from an ElementArena (AnalogSensor::add_stage) :
+ *  -> a MedianFilter<5> added in front of the filter of one Potentiometer : its outputs against a plain Potentiometer fed
+ *     with the outputs of a standalone MedianFilter<5>, and the spikes reaching the output with and without it
+ *  -> the block of the median given back and reused by a NoiseStats, arena full, Axis (full pipeline unless PIPELINE_SIZE > 6)
+ *  -> host ticks per add_stage() + remove_stage() cycle
+ *  -> footprint : arena vs a median member in each of the 7 sensors of Pots_and_Axis_implementation.cpp
+ * The static and shared pipelines have no runtime stage : the program only says so.
+ *
+ * Usage : arena_bench [samples]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include "Sensors.h"
+
+#define BLOCK_SIZE (sizeof(MedianFilter<5>) > sizeof(NoiseStats) ? sizeof(MedianFilter<5>) : sizeof(NoiseStats))
+
+ElementPool<BLOCK_SIZE, 2> pool;
+Potentiometer pots[3];	// pots[0] : median stage, pots[1] : reference fed by a standalone median, pots[2] : no median
+MedianFilter<5> median;
+Axis axis;
+
+static uint32_t noise_state = 12345;
+static uint16_t noisy_sample(uint32_t n)
+{
+	noise_state = noise_state * 1103515245 + 12345;
+	uint16_t sample = 512 + (int16_t)((noise_state >> 16) % 9) - 4;
+	if((noise_state >> 8) % 50 == 0) sample = (n & 1) ? 1023 : 0;	// Single sample spike
+	return sample;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t samples = 100000;
+	if(argc > 1) samples = atoi(argv[1]);
+
+	MedianFilter<5>* stage = pots[0].add_stage<MedianFilter<5> >(&pool, 0);
+	if(stage == NULL) {
+		printf("No runtime stage with the static or shared pipeline\n");
+		return 0;
+	}
+
+	// Median on the raw samples of pots[0] only
+	uint32_t mismatches = 0;
+	uint32_t spikes[2] = {0, 0};	// Outputs off by more than 10 % of the output span : with, without the median
+	for(uint32_t n = 0; n < samples; n++) {
+		uint16_t sample = noisy_sample(n);
+		pots[0].set_adc_result(sample);
+		pots[1].set_adc_result(median.compute(sample));
+		pots[2].set_adc_result(sample);
+		for(uint8_t i = 0; i < 3; i++) pots[i].update_result();
+		if(pots[0].read_sensor() != pots[1].read_sensor()) mismatches++;
+		if(n < 16) continue;	// Windows fill up
+		int16_t center = pots[1].get_output_space_ptr()->get_min() + pots[1].get_output_space_ptr()->get_delta() / 2;
+		int16_t limit = pots[1].get_output_space_ptr()->get_delta() / 10;
+		if(abs(pots[0].read_sensor() - center) > limit) spikes[0]++;
+		if(abs(pots[2].read_sensor() - center) > limit) spikes[1]++;
+	}
+	printf("Median stage : %u mismatches / %u samples, spikes at the output : %u (median), %u (no median)\n", mismatches, samples,
+		   spikes[0], spikes[1]);
+
+	// Block reuse
+	uint8_t removed = pots[0].remove_stage(stage, &pool);
+	NoiseStats* stats = pots[0].add_stage<NoiseStats>(&pool, 0);
+	NoiseStats* second = pots[2].add_stage<NoiseStats>(&pool, 0);
+	NoiseStats* third = pots[1].add_stage<NoiseStats>(&pool, 0);
+	uint8_t ok = removed && (void*) stats == (void*) stage && second != NULL && third == NULL;
+	pots[0].remove_stage(stats, &pool);
+	pots[2].remove_stage(second, &pool);
+	MedianFilter<5>* axis_stage = axis.add_stage<MedianFilter<5> >(&pool, 0);
+	printf("Block reused : %s, arena full : %s, Axis : %s\n", (void*) stats == (void*) stage ? "yes" : "no",
+		   third == NULL ? "NULL" : "allocated", axis_stage == NULL ? "NULL (pipeline full)" : "allocated (PIPELINE_SIZE > 6)");
+	if(axis_stage != NULL) axis.remove_stage(axis_stage, &pool);
+	ok = ok && pool.get_free_nb() == pool.get_block_nb();
+
+	// Allocation cost
+	uint64_t start = sim_host_ticks();
+	for(uint32_t n = 0; n < samples; n++) {
+		MedianFilter<5>* element = pots[2].add_stage<MedianFilter<5> >(&pool, 0);
+		pots[2].remove_stage(element, &pool);
+	}
+	printf("Host ticks per add_stage() + remove_stage() : %.1f\n", (double)(sim_host_ticks() - start) / samples);
+
+	printf("sizeof : MedianFilter<5> %lu, NoiseStats %lu, pool of %u blocks %lu (vs %lu for a median in 7 sensors)\n",
+		   (unsigned long) sizeof(MedianFilter<5>), (unsigned long) sizeof(NoiseStats), pool.get_block_nb(),
+		   (unsigned long) sizeof(pool), (unsigned long)(7 * sizeof(MedianFilter<5>)));
+	return mismatches != 0 || !ok;
+}
@@ -0,0 +1,298 @@
+/*
+ * bench_gimbals_pots
+ * Host benchmark (see Host_simulation/Readme.md) reproducing the Pots_and_Axis_implementation.cpp workload :
+ * 2 Gimbals (4 Axes) and 3 Potentiometers sharing one Adc, same main loop, same deadzones.
+ * Inputs are deterministic (slow sines + pseudo random noise) so that two runs give the same numbers.
+ *
+ * Reports :
+ *  -> per sensor effective sample rate (conversions delivered, samples processed by update_result, samples lost)
+ *  -> request rejections : sensor quota reached (AdcHandler full) or pending list full (Adc::add_request returned 0)
+ *  -> ADC_REQ_LATCH hysteresis : number of times the list latched full, time spent latched and requests
+ *     discarded while the list was latched but had free slots
+ *  -> worst interval between two conversions of the same sensor (scheduling latency)
+ *  -> host ticks per processed sample : set_adc_result() + update_result(), i.e. the sample ring push / pop and the
+ *     transform() of the pipeline (samples of the run replayed through identical sensors)
+ *
+ * Usage : bench_gimbals_pots [--scan] [--prio gimbal_priority pot_priority] [--oversample n] [gimbal_max_req] [pot_max_req] [main_loop_cycles] [simulated_seconds]
+ * ADC_REQUEST_SIZE is tuned at build time : -DADC_REQUEST_SIZE=n
+ * --scan : sensors are sampled by the Adc scan mode (free running) instead of the request queue,
+ *          compare the "samples/s" line of both runs to get the throughput gain
+ * --prio : HardwareActuator priorities of the axes and of the pots (0..255), only accepted by -DADC_PRIORITY_SCHEDULER builds
+ * --oversample : axes results are decimated from 4^n conversions (10 + n bits, axes ranges are scaled by 2^n)
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "adc_tools.h"
+#include "Sensors.h"
+
+#define SENSOR_NB 7
+#define REPLAY_SIZE 4096	// Raw samples recorded per sensor for the per sample timing
+#define REPLAY_LOOPS 50
+
+Adc adc;
+Potentiometer pot1,pot2,pot3;
+Gimbal left_g,right_g;
+
+// Replay set : same configuration, fed with the samples recorded during the run
+Potentiometer r_pot1,r_pot2,r_pot3;
+Gimbal r_left_g,r_right_g;
+
+const char* sensor_names[SENSOR_NB] = {"left_g.x", "left_g.y", "right_g.x", "right_g.y", "pot1", "pot2", "pot3"};
+AnalogSensor* sensors[SENSOR_NB];
+AnalogSensor* replay_sensors[SENSOR_NB];
+
+struct SensorStats {
+	uint32_t sent;			// send_adc_request calls
+	uint32_t accepted;		// requests stored in the pending list
+	uint32_t quota_rejected;	// AdcHandler full (max_request_nb reached)
+	uint32_t adc_rejected;		// Adc::add_request returned 0
+	uint32_t converted;		// results pushed by the ISR
+	uint32_t processed;		// results consumed by update_result
+	uint64_t last_conversion;	// cpu cycle of the last result
+	uint64_t max_gap;		// worst interval between two results
+	uint16_t replay[REPLAY_SIZE];
+	uint16_t replay_nb;
+};
+SensorStats stats[SENSOR_NB];
+
+// ADC_REQ_LATCH hysteresis tracking
+uint32_t latch_nb = 0;
+uint32_t latched_free_rejects = 0;	// Requests discarded while the list had free slots (hysteresis only)
+uint64_t latch_start = 0, latched_cycles = 0;
+uint8_t latched = 0;
+
+static void track_latch()
+{
+	uint8_t state = adc.is_full();
+	if(state && !latched) {latch_nb++; latch_start = sim_adc.get_cycles();}
+	if(!state && latched) latched_cycles += sim_adc.get_cycles() - latch_start;
+	latched = state;
+}
+
+// Deterministic inputs : sticks wander around their center, pots slowly sweep their range
+static uint32_t noise_state = 12345;
+static int16_t noise(int16_t amplitude)
+{
+	noise_state = noise_state * 1103515245 + 12345;
+	return (int16_t)((noise_state >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+static uint16_t input_source(uint8_t channel, uint64_t cycle)
+{
+	double t = (double) cycle / F_CPU;
+	int32_t value;
+	if(channel < 4) value = 512 + (int32_t)(300 * sin(2 * M_PI * (0.5 + 0.3 * channel) * t)) + noise(4);
+	else value = 512 + (int32_t)(500 * sin(2 * M_PI * 0.1 * (channel - 3) * t)) + noise(2);
+	if(value < 0) value = 0;
+	if(value > 1023) value = 1023;
+	return value;
+}
+
+static uint8_t sensor_index(AnalogSensor* sensor)
+{
+	for(uint8_t i = 0; i < SENSOR_NB; i++) if(sensors[i] == sensor) return i;
+	return SENSOR_NB;
+}
+
+ISR(ADC_vect){
+	uint8_t index = sensor_index(adc.get_current_sensor_id());
+	uint8_t before = index < SENSOR_NB ? sensors[index]->get_adc_handler_ptr()->get_tot_req_nb() : 0;
+	adc.handle_conversion();
+	track_latch();
+	if(index >= SENSOR_NB) return;
+	// Oversampling : intermediate conversions deliver nothing (the request is still running)
+	if(!adc.is_scanning() && sensors[index]->get_adc_handler_ptr()->get_tot_req_nb() == before) return;
+	SensorStats* s = &stats[index];
+	s->converted++;
+	uint64_t now = sim_adc.get_cycles();
+	if(s->converted > 1 && now - s->last_conversion > s->max_gap) s->max_gap = now - s->last_conversion;
+	s->last_conversion = now;
+	if(s->replay_nb < REPLAY_SIZE) s->replay[s->replay_nb++] = sensors[index]->get_adc_result();
+}
+
+static void tracked_request(uint8_t index)
+{
+	AnalogSensor* sensor = sensors[index];
+	SensorStats* s = &stats[index];
+	AdcHandler* handler = sensor->get_adc_handler_ptr();
+	uint8_t before = handler->get_tot_req_nb();
+	uint8_t was_latched = adc.is_full();
+	s->sent++;
+	if(handler->is_full()) s->quota_rejected++;
+	else {
+		sensor->send_adc_request(&adc);
+		if(handler->get_tot_req_nb() != before) s->accepted++;
+		else {
+			s->adc_rejected++;
+			if(was_latched && adc.get_pending_req_nb() < ADC_REQUEST_SIZE) latched_free_rejects++;
+		}
+	}
+	track_latch();
+}
+
+static void tracked_update(uint8_t index)
+{
+	stats[index].processed += sensors[index]->update_result();
+}
+
+// Same setup as Pots_and_Axis_implementation.cpp main()
+static void configure(Gimbal* left, Gimbal* right, Potentiometer* p1, Potentiometer* p2, Potentiometer* p3,
+					  uint8_t gimbal_max_req, uint8_t pot_max_req, uint8_t gimbal_prio, uint8_t pot_prio, uint8_t oversample)
+{
+	left->get_x_axis_ptr()->set_deadzone(480 << oversample,550 << oversample,((480 + 550)/2) << oversample,0);
+	left->get_y_axis_ptr()->set_deadzone(460 << oversample,620 << oversample,((460 + 620)/2) << oversample,0);
+	left->set_adc_muxes(ADC0D,ADC1D);
+	right->get_x_axis_ptr()->set_deadzone(510 << oversample,514 << oversample,512 << oversample,0);
+	right->get_y_axis_ptr()->set_bypass(TransformElement::DZone,1);
+	right->set_adc_muxes(ADC2D,ADC3D);
+	// Pots are wired on ADC4..6 (the original main leaves them on the default mux)
+	p1->set_adc_mux(ADC4D); p2->set_adc_mux(ADC5D); p3->set_adc_mux(6);
+	left->get_x_axis_ptr()->set_max_adc_req(gimbal_max_req);
+	left->get_y_axis_ptr()->set_max_adc_req(gimbal_max_req);
+	right->get_x_axis_ptr()->set_max_adc_req(gimbal_max_req);
+	right->get_y_axis_ptr()->set_max_adc_req(gimbal_max_req);
+	p1->set_max_adc_req(pot_max_req); p2->set_max_adc_req(pot_max_req); p3->set_max_adc_req(pot_max_req);
+#ifdef ADC_PRIORITY_SCHEDULER
+	left->get_x_axis_ptr()->set_priority(gimbal_prio);
+	left->get_y_axis_ptr()->set_priority(gimbal_prio);
+	right->get_x_axis_ptr()->set_priority(gimbal_prio);
+	right->get_y_axis_ptr()->set_priority(gimbal_prio);
+	p1->set_priority(pot_prio); p2->set_priority(pot_prio); p3->set_priority(pot_prio);
+#endif
+	Axis* axes[4] = {left->get_x_axis_ptr(), left->get_y_axis_ptr(), right->get_x_axis_ptr(), right->get_y_axis_ptr()};
+	for(uint8_t i = 0; i < 4 && oversample; i++) {
+		LinearSpace* in = axes[i]->get_input_space_ptr();
+		LinearSpace* out = axes[i]->get_output_space_ptr();
+		axes[i]->set_ranges(in->get_min() << oversample, in->get_max() << oversample, out->get_min(), out->get_max());
+		axes[i]->get_adc_handler_ptr()->set_oversampling(oversample);
+	}
+}
+
+// Reads a 0..255 priority, returns 0 if "text" isn't one
+static uint8_t parse_priority(const char* text, uint8_t* priority)
+{
+	char* end;
+	long value = strtol(text, &end, 10);
+	if(end == text || *end != '\0' || value < 0 || value > 255) return 0;
+	*priority = value;
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	uint8_t gimbal_max_req = 4, pot_max_req = 4;	// AdcHandler default (max_Sensor_Requests)
+	uint32_t loop_cycles = 1500;	// Simulated cost of one main loop pass
+	double duration = 2.0;
+	uint8_t scan = 0;
+	uint8_t gimbal_prio = 0, pot_prio = 0;
+	uint8_t oversample = 0;
+	if(argc > 1 && strcmp(argv[1], "--scan") == 0) {
+		scan = 1;
+		argc--;
+		argv++;
+	}
+	if(argc > 1 && strcmp(argv[1], "--prio") == 0) {
+#ifndef ADC_PRIORITY_SCHEDULER
+		fprintf(stderr, "--prio : priorities are only used by -DADC_PRIORITY_SCHEDULER builds\n");
+		return 1;
+#endif
+		if(argc < 4 || !parse_priority(argv[2], &gimbal_prio) || !parse_priority(argv[3], &pot_prio)) {
+			fprintf(stderr, "--prio : expected two priorities (0..255) : --prio gimbal_priority pot_priority\n");
+			return 1;
+		}
+		argc -= 3;
+		argv += 3;
+	}
+	if(argc > 2 && strcmp(argv[1], "--oversample") == 0) {
+		oversample = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+	if(argc > 1) gimbal_max_req = atoi(argv[1]);
+	if(argc > 2) pot_max_req = atoi(argv[2]);
+	if(argc > 3) loop_cycles = atoi(argv[3]);
+	if(argc > 4) duration = atof(argv[4]);
+	uint32_t step_cycles = loop_cycles / 9;	// 9 calls per main loop pass
+
+	AnalogSensor* set[SENSOR_NB] = {left_g.get_x_axis_ptr(), left_g.get_y_axis_ptr(), right_g.get_x_axis_ptr(),
+									right_g.get_y_axis_ptr(), &pot1, &pot2, &pot3};
+	AnalogSensor* r_set[SENSOR_NB] = {r_left_g.get_x_axis_ptr(), r_left_g.get_y_axis_ptr(), r_right_g.get_x_axis_ptr(),
+									  r_right_g.get_y_axis_ptr(), &r_pot1, &r_pot2, &r_pot3};
+	for(uint8_t i = 0; i < SENSOR_NB; i++) {sensors[i] = set[i]; replay_sensors[i] = r_set[i];}
+	configure(&left_g, &right_g, &pot1, &pot2, &pot3, gimbal_max_req, pot_max_req, gimbal_prio, pot_prio, oversample);
+	configure(&r_left_g, &r_right_g, &r_pot1, &r_pot2, &r_pot3, gimbal_max_req, pot_max_req, gimbal_prio, pot_prio, oversample);
+
+	sim_adc.set_isr_cycles(80);
+	sim_adc.set_input_source(input_source);
+	adc.initialize();
+	if(scan) {
+		for(uint8_t i = 0; i < SENSOR_NB; i++) adc.add_scan_sensor(sensors[i]);
+		adc.start_scan();
+	}
+	sei();
+
+	uint64_t end = (uint64_t)(duration * F_CPU);
+	while(sim_adc.get_cycles() < end)
+	{
+		// Send adc requests of Gimbals (x then y, as Gimbal::send_adc_requests does)
+		// Scan mode needs no request traffic at all
+		if(!scan) {tracked_request(0); tracked_request(1); sim_adc.run(step_cycles);}
+		if(!scan) {tracked_request(2); tracked_request(3); sim_adc.run(step_cycles);}
+		// Updates gimbals values
+		tracked_update(0); tracked_update(1); sim_adc.run(step_cycles);
+		tracked_update(2); tracked_update(3); sim_adc.run(step_cycles);
+		// Send adc requests of pots
+		for(uint8_t i = 4; i < SENSOR_NB && !scan; i++) {tracked_request(i); sim_adc.run(step_cycles / 2);}
+		// Updates pots values
+		for(uint8_t i = 4; i < SENSOR_NB; i++) {tracked_update(i); sim_adc.run(step_cycles);}
+	}
+	if(latched) latched_cycles += sim_adc.get_cycles() - latch_start;
+
+	double seconds = sim_adc.cycles_to_seconds(sim_adc.get_cycles());
+	uint32_t delivered = 0;
+	for(uint8_t i = 0; i < SENSOR_NB; i++) delivered += stats[i].converted;
+	if(scan) printf("Configuration : scan mode (free running), %d sensors\n", SENSOR_NB);
+	else printf("Configuration : ADC_REQUEST_SIZE = %d, ADC_REQ_LATCH = %d, gimbal max_request_nb = %u, pot max_request_nb = %u\n",
+				ADC_REQUEST_SIZE, ADC_REQ_LATCH, gimbal_max_req, pot_max_req);
+	printf("Simulated     : %.3f s, main loop = %u cycles, %u conversions (%.0f conv/s, ADC busy %.1f %%)\n", seconds,
+		   loop_cycles, sim_adc.get_conversion_nb(), sim_adc.get_conversion_nb() / seconds,
+		   100.0 * sim_adc.get_busy_cycles() / sim_adc.get_cycles());
+	printf("Samples       : %.0f samples/s delivered to the sensors\n", delivered / seconds);
+	printf("Latch         : %u latches (%.1f /s), latched %.1f %% of the time, %u requests discarded with free slots\n",
+		   latch_nb, latch_nb / seconds, 100.0 * latched_cycles / sim_adc.get_cycles(), latched_free_rejects);
+	printf("\n%-9s | %8s | %8s | %6s | %8s | %8s | %6s | %10s\n", "sensor", "conv/s", "proc/s", "lost", "quota %", "adc %", "sent",
+		   "max gap us");
+	for(uint8_t i = 0; i < SENSOR_NB; i++)
+	{
+		SensorStats* s = &stats[i];
+		printf("%-9s | %8.0f | %8.0f | %6u | %8.1f | %8.1f | %6u | %10.0f\n", sensor_names[i], s->converted / seconds,
+			   s->processed / seconds, sensors[i]->get_lost_samples(), s->sent ? 100.0 * s->quota_rejected / s->sent : 0.0,
+			   s->sent ? 100.0 * s->adc_rejected / s->sent : 0.0, s->sent, 1e6 * sim_adc.cycles_to_seconds(s->max_gap));
+	}
+
+	// Per sample timing : recorded samples are replayed through the replay set (ISR -> update_result path, transform() included)
+	printf("\n%-9s | %s\n", "sensor", "host ticks per sample (set_adc_result + update_result)");
+	for(uint8_t i = 0; i < SENSOR_NB; i++)
+	{
+		SensorStats* s = &stats[i];
+		AnalogSensor* sensor = replay_sensors[i];
+		if(s->replay_nb == 0) continue;
+		uint64_t start = sim_host_ticks();
+		for(uint16_t loop = 0; loop < REPLAY_LOOPS; loop++)
+			for(uint16_t n = 0; n < s->replay_nb; n++)
+			{
+				sensor->set_adc_result(s->replay[n]);
+				sensor->update_result();
+			}
+		uint64_t ticks = sim_host_ticks() - start;
+		printf("%-9s | %.1f (output %d)\n", sensor_names[i], (double) ticks / (REPLAY_LOOPS * s->replay_nb), sensor->read_sensor());
+	}
+	return 0;
+}
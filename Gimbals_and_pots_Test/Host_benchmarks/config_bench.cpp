@@ -0,0 +1,147 @@
+/*
+ * config_bench
+ * Host program (see Host_simulation/Readme.md) checking the sensors built from flash tables (SensorConfig.h) against the
+ * startup of Pots_and_Axis_implementation.cpp before the tables (default constructors, then set_deadzone(), set_adc_muxes(),
+ * set_bypass()...) :
+ *  -> settings of both sensor sets (channels, paired requests, priorities, oversampling), and of a table with a priority and
+ *     oversampling
+ *  -> outputs of both sensor sets, and of a SensorBank built from the same tables, for the same random samples
+ *  -> host ticks to build the whole sensor set (2 Gimbals + 3 Potentiometers) both ways, best of interleaved rounds
+ *
+ * Usage : config_bench [samples]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <avr/io.h>
+#include "Sensors.h"
+#include "SensorBank.h"
+
+// Same tables as Pots_and_Axis_implementation.cpp
+constexpr GimbalConfig left_config PROGMEM = {
+	{ADC0D, 0, 1023, -100, 100, 480, 550, (480 + 550)/2, AXIS_DEFAULT_BYPASS, 0, 0},
+	{ADC1D, 0, 1023, -100, 100, 460, 620, (460 + 620)/2, AXIS_DEFAULT_BYPASS, 0, 0},
+	0, 0
+};
+constexpr GimbalConfig right_config PROGMEM = {
+	{ADC2D, 0, 1023, -100, 100, 510, 514, 512, AXIS_DEFAULT_BYPASS, 0, 0},
+	{ADC3D, 0, 1023, -100, 100, 512, 512, 512, AXIS_DEFAULT_BYPASS | SENSOR_BYPASS(DZone), 0, 0},
+	0, 0
+};
+constexpr SensorConfig pot_configs[3] PROGMEM = {
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+};
+constexpr SensorConfig weighted_config PROGMEM = {ADC4D, 0, 2046, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 3, 1};	// 11 bits
+static_assert(is_valid_config(left_config) && is_valid_config(right_config), "Invalid gimbal settings");
+static_assert(is_valid_config(pot_configs[0]) && is_valid_config(pot_configs[1]) && is_valid_config(pot_configs[2]),
+			  "Invalid potentiometer settings");
+
+// One sensor set, built in place so that its startup can be timed
+struct SensorSet {
+	Gimbal left_g, right_g;
+	Potentiometer pot1, pot2, pot3;	// Not copied : their pipelines point to their own elements
+	SensorSet() {}	// Setters path
+	SensorSet(uint8_t) : left_g(&left_config), right_g(&right_config), pot1(&pot_configs[0]), pot2(&pot_configs[1]),
+						 pot3(&pot_configs[2]) {}
+};
+
+alignas(SensorSet) static uint8_t setter_storage[sizeof(SensorSet)];
+alignas(SensorSet) static uint8_t table_storage[sizeof(SensorSet)];
+
+// Startup of Pots_and_Axis_implementation.cpp before the tables
+static SensorSet* build_with_setters()
+{
+	SensorSet* set = new(setter_storage) SensorSet();
+	set->left_g.get_x_axis_ptr()->set_deadzone(480,550,(480 + 550)/2,0);
+	set->left_g.get_y_axis_ptr()->set_deadzone(460,620,(460 + 620)/2,0);
+	set->left_g.set_adc_muxes(ADC0D,ADC1D);
+	set->right_g.get_x_axis_ptr()->set_deadzone(510,514,512,0);
+	set->right_g.get_y_axis_ptr()->set_bypass(TransformElement::DZone,1);
+	set->right_g.set_adc_muxes(ADC2D,ADC3D);
+	return set;
+}
+
+static SensorSet* build_from_tables() {return new(table_storage) SensorSet(0);}
+
+static AnalogSensor* sensor(SensorSet* set, uint8_t i)
+{
+	Axis* axes[4] = {set->left_g.get_x_axis_ptr(), set->left_g.get_y_axis_ptr(), set->right_g.get_x_axis_ptr(),
+					 set->right_g.get_y_axis_ptr()};
+	AnalogSensor* pots[3] = {&set->pot1, &set->pot2, &set->pot3};
+	return i < 4 ? (AnalogSensor*) axes[i] : pots[i - 4];
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t samples = 100000;
+	if(argc > 1) samples = atoi(argv[1]);
+
+	// Same outputs
+	SensorSet* setters = build_with_setters();
+	SensorSet* tables = build_from_tables();
+	SensorBank bank;
+	const SensorConfig* axis_configs[4] = {&left_config.x, &left_config.y, &right_config.x, &right_config.y};
+	for(uint8_t i = 0; i < 4; i++) bank.add_sensor(axis_configs[i]);
+	uint32_t mismatches = 0, bank_mismatches = 0;
+	uint8_t settings_ok = setters->left_g.is_paired() == tables->left_g.is_paired() &&
+						  setters->right_g.is_paired() == tables->right_g.is_paired();
+	for(uint8_t i = 0; i < 7; i++) {
+		AnalogSensor* setter_sensor = sensor(setters, i);
+		AnalogSensor* table_sensor = sensor(tables, i);
+		settings_ok = settings_ok && setter_sensor->get_adc_mux() == table_sensor->get_adc_mux() &&
+					  setter_sensor->get_priority() == table_sensor->get_priority() &&
+					  setter_sensor->get_adc_handler_ptr()->get_oversampling() == table_sensor->get_adc_handler_ptr()->get_oversampling();
+	}
+	// Scheduler weight and oversampling given by a table
+	Potentiometer weighted(&weighted_config);
+	settings_ok = settings_ok && weighted.get_priority() == 3 && weighted.get_adc_handler_ptr()->get_oversampling() == 1;
+	uint32_t noise_state = 12345;
+	for(uint32_t n = 0; n < samples; n++) {
+		for(uint8_t i = 0; i < 7; i++) {
+			noise_state = noise_state * 1103515245 + 12345;
+			uint16_t sample = (noise_state >> 16) % 1024;
+			sensor(setters, i)->set_adc_result(sample);
+			sensor(tables, i)->set_adc_result(sample);
+			if(i < 4) bank.set_sample(i, sample);
+		}
+		bank.round_complete(0);
+		bank.update();
+		setters->left_g.update_sensors();
+		setters->right_g.update_sensors();
+		tables->left_g.update_sensors();
+		tables->right_g.update_sensors();
+		for(uint8_t i = 4; i < 7; i++) {
+			sensor(setters, i)->update_result();
+			sensor(tables, i)->update_result();
+		}
+		for(uint8_t i = 0; i < 7; i++) if(sensor(setters, i)->read_sensor() != sensor(tables, i)->read_sensor()) mismatches++;
+		for(uint8_t i = 0; i < 4; i++) if(bank.read_sensor(i) != sensor(tables, i)->read_sensor()) bank_mismatches++;
+	}
+	printf("Settings : %s, mismatches : %u (sensors) %u (SensorBank) / %u samples\n", settings_ok ? "same" : "DIFFERENT", mismatches,
+		   bank_mismatches, samples);
+
+	// Startup : both ways interleaved, best of 20 rounds (host timing noise)
+	uint32_t builds = samples / 200 + 1;
+	uint64_t setter_ticks = 0, table_ticks = 0;
+	for(uint8_t round = 0; round < 20; round++) {
+		uint64_t start = sim_host_ticks();
+		for(uint32_t n = 0; n < builds; n++) build_with_setters();
+		uint64_t ticks = sim_host_ticks() - start;
+		if(round == 0 || ticks < setter_ticks) setter_ticks = ticks;
+		start = sim_host_ticks();
+		for(uint32_t n = 0; n < builds; n++) build_from_tables();
+		ticks = sim_host_ticks() - start;
+		if(round == 0 || ticks < table_ticks) table_ticks = ticks;
+	}
+	printf("Host ticks per sensor set startup (best of 20 rounds) : %.1f (setters), %.1f (tables)\n", (double) setter_ticks / builds,
+		   (double) table_ticks / builds);
+	printf("sizeof : SensorConfig %lu, GimbalConfig %lu, tables %lu (flash)\n", (unsigned long) sizeof(SensorConfig),
+		   (unsigned long) sizeof(GimbalConfig), (unsigned long)(2 * sizeof(GimbalConfig) + sizeof(pot_configs)));
+	return mismatches != 0 || bank_mismatches != 0 || !settings_ok;
+}
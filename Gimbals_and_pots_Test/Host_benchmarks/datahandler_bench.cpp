@@ -0,0 +1,127 @@
+/*
+ * datahandler_bench
+ * Host program checking and timing the DataHandler mapping modes :
+ *  -> division (compute_exact, reference), fixed-point reciprocal (default compute) and lookup table
+ *  -> every input in [-512 ; 1535] (up to 512 past the input space for the oversampled ones) is checked against the reference
+ *     for thousands of random ranges (reverse included)
+ * Host ticks only give a trend (x86 divides in hardware) : on the Atmega328P the division is done by libgcc
+ * (__divmodsi4, several hundreds of cycles) while the reciprocal needs one 16x32 bits multiplication and a shift.
+ * It also prints a PROGMEM lookup table for given ranges, to be pasted in the firmware (flash table mode) :
+ *
+ * Usage : datahandler_bench
+ *         datahandler_bench --table in_min in_max out_min out_max reverse
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "S_PipeElement.h"
+#include "sim_adc.h"
+
+#define CONFIG_NB 20000
+#define TIMING_LOOPS 2000
+
+static int16_t random_in(int16_t low, int16_t high) {return low + rand() % (high - low + 1);}
+
+static void print_table(int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max, uint8_t reverse)
+{
+	static int16_t table[DH_TABLE_SIZE];
+	DataHandler handler(in_min, in_max, out_min, out_max, reverse);
+	handler.fill_table(table);
+	printf("// DataHandler(%d, %d, %d, %d, %u) -> use_flash_table()\n", in_min, in_max, out_min, out_max, reverse);
+	printf("const int16_t datahandler_table[DH_TABLE_SIZE] PROGMEM = {");
+	for(uint16_t i = 0; i < DH_TABLE_SIZE; i++) printf("%s%d", i % 16 ? ", " : (i ? ",\n\t" : "\n\t"), table[i]);
+	printf("\n};\n");
+}
+
+int main(int argc, char** argv)
+{
+	if(argc == 7 && strcmp(argv[1], "--table") == 0) {
+		print_table(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), atoi(argv[5]), atoi(argv[6]));
+		return 0;
+	}
+
+	// Exactness : fast path and table against the division
+	static int16_t table[DH_TABLE_SIZE];
+	uint32_t mismatches = 0, checked = 0;
+	srand(1);
+	for(uint32_t n = 0; n < CONFIG_NB; n++)
+	{
+		int16_t in_min, in_max, out_min, out_max;
+		switch(n % 5) {
+			case 0 :	// Usual sensors : sub range of the adc, small output span
+				in_min = random_in(0, 500); in_max = random_in(520, 1023);
+				out_min = random_in(-1000, 0); out_max = random_in(1, 1000);
+				break;
+			case 1 :	// Inverted spaces and narrow inputs
+				in_min = random_in(0, 1023); in_max = in_min + random_in(-20, 20);
+				out_min = random_in(-2000, 2000); out_max = random_in(-2000, 2000);
+				break;
+			case 2 :	// Wide output spans
+				in_min = random_in(-200, 300); in_max = random_in(700, 1300);
+				out_min = random_in(-32000, 0); out_max = random_in(0, 32000);
+				break;
+			case 3 :	// Oversampled inputs (11 to 13 bits)
+				in_min = random_in(0, 1000); in_max = random_in(1100, 8191);
+				out_min = random_in(-1000, 0); out_max = random_in(1, 1000);
+				break;
+			default :	// Anything
+				in_min = random_in(-32000, 32000); in_max = random_in(-32000, 32000);
+				out_min = random_in(-32000, 32000); out_max = random_in(-32000, 32000);
+				break;
+		}
+		if(in_min == in_max) in_max++;
+		uint8_t reverse = rand() % 2;
+		DataHandler handler;
+		handler.set_ranges(in_min, in_max, out_min, out_max);
+		handler.reverse(reverse);
+		DataHandler table_handler(in_min, in_max, out_min, out_max, reverse);
+		table_handler.use_ram_table(table);
+		int16_t last_input = in_max > 1023 && in_max < 8192 ? in_max + 512 : 1535;
+		for(int16_t input = -512; input <= last_input; input++)
+		{
+			int16_t reference = handler.compute_exact(input);
+			if(handler.compute(input) != reference || table_handler.compute(input) != reference) {
+				if(mismatches++ < 10) printf("Mismatch : (%d %d %d %d rev %u) input %d -> %d / %d, expected %d\n",
+											 in_min, in_max, out_min, out_max, reverse, input, handler.compute(input),
+											 table_handler.compute(input), reference);
+			}
+			checked++;
+		}
+	}
+	printf("Exactness : %u inputs checked over %u ranges, %u mismatches\n", checked, CONFIG_NB, mismatches);
+
+	// Timing : default Axis/Potentiometer mapping (0..1023 -> -100..100)
+	DataHandler handler;
+	DataHandler table_handler;
+	table_handler.use_ram_table(table);
+	volatile int16_t sink = 0;
+	uint64_t start, ticks_exact, ticks_fast, ticks_table;
+	start = sim_host_ticks();
+	for(uint16_t loop = 0; loop < TIMING_LOOPS; loop++) for(int16_t i = 0; i < DH_TABLE_SIZE; i++) sink = handler.compute_exact(i);
+	ticks_exact = sim_host_ticks() - start;
+	start = sim_host_ticks();
+	for(uint16_t loop = 0; loop < TIMING_LOOPS; loop++) for(int16_t i = 0; i < DH_TABLE_SIZE; i++) sink = handler.compute(i);
+	ticks_fast = sim_host_ticks() - start;
+	start = sim_host_ticks();
+	for(uint16_t loop = 0; loop < TIMING_LOOPS; loop++) for(int16_t i = 0; i < DH_TABLE_SIZE; i++) sink = table_handler.compute(i);
+	ticks_table = sim_host_ticks() - start;
+	(void) sink;
+	double samples = (double) TIMING_LOOPS * DH_TABLE_SIZE;
+	printf("Host ticks per sample : division %.2f | reciprocal %.2f | table %.2f\n",
+		   ticks_exact / samples, ticks_fast / samples, ticks_table / samples);
+
+	// Timing : 12 bits oversampled input (0..4095 -> -100..100), reciprocal over the whole input space
+	DataHandler oversampled(0, 4095, -100, 100, 0);
+	start = sim_host_ticks();
+	for(uint16_t loop = 0; loop < TIMING_LOOPS / 4; loop++) for(int16_t i = 0; i < 4096; i++) sink = oversampled.compute_exact(i);
+	ticks_exact = sim_host_ticks() - start;
+	start = sim_host_ticks();
+	for(uint16_t loop = 0; loop < TIMING_LOOPS / 4; loop++) for(int16_t i = 0; i < 4096; i++) sink = oversampled.compute(i);
+	ticks_fast = sim_host_ticks() - start;
+	printf("12 bits input, host ticks per sample : division %.2f | reciprocal %.2f\n", ticks_exact / samples, ticks_fast / samples);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * dispatch_bench
+ * Host program (see Host_simulation/Readme.md) measuring the element dispatch and the footprint of the pipeline : build it
+ * with and without -DTAGGED_ELEMENT_DISPATCH (or -DSHARED_PIPELINE_TOPOLOGY), and compare the outputs.
+ *  -> sizes of the elements and of the sensors of Pots_and_Axis_implementation.cpp (4 Axes + 3 Potentiometers)
+ *  -> host ticks per sample of an Axis (every stage active, changing input : nothing is memoized) and of a Potentiometer
+ *  -> host ticks per compute() call through TransformElement*, for each element class
+ * Host pointers are 8 bytes long : on the AVR a vptr is 2 bytes. The 30 elements of Pots_and_Axis_implementation.cpp then hold
+ * 60 bytes of vptrs, plus 7 vtables (10 bytes each) copied to SRAM : about 130 bytes saved by the tagged dispatch.
+ *
+ * Usage : dispatch_bench [samples]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include "Sensors.h"
+
+Axis axes[4];
+Potentiometer pots[3];
+
+DataFilter data_filter;
+Deadzone deadzone(480, 550, 515, 0);
+DataHandler data_handler;
+TrimHandler trim;
+Modifier modifier;
+EmaFilter<2> ema;	// External element with the tagged dispatch
+
+struct Candidate {
+	const char* name;
+	TransformElement* element;
+};
+
+// Batches of 1000 samples (set_adc_result() + update_result()), best batch of the run : host timing noise and the cost
+// of reading the counter stay out of the figure
+static double time_sensor(AnalogSensor* sensor, uint32_t samples)
+{
+	volatile int16_t sink = 0;	// Keeps the reads alive
+	uint64_t best = 0;
+	for(uint32_t batch = 0; batch < samples / 1000 + 1; batch++) {
+		uint64_t start = sim_host_ticks();
+		for(uint16_t n = 0; n < 1000; n++) {
+			sensor->set_adc_result(400 + (n & 255));
+			sensor->update_result();
+			sink += sensor->read_sensor();
+		}
+		uint64_t ticks = sim_host_ticks() - start;
+		if(batch == 0 || ticks < best) best = ticks;
+	}
+	return best / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t samples = 1000000;
+	if(argc > 1) samples = atoi(argv[1]);
+#ifdef TAGGED_ELEMENT_DISPATCH
+	printf("Tagged dispatch (-DTAGGED_ELEMENT_DISPATCH)");
+#else
+	printf("Virtual dispatch");
+#endif
+#ifdef STATIC_TRANSFORM_PIPELINE
+	printf(", StaticPipeline\n");
+#elif defined(SHARED_PIPELINE_TOPOLOGY)
+	printf(", SharedPipeline\n");
+#else
+	printf(", TransformPipeline\n");
+#endif
+
+	// Sizes
+	printf("sizeof : TransformElement %lu, DataFilter %lu, Deadzone %lu, DataHandler %lu, TrimHandler %lu, Modifier %lu, NoiseStats %lu\n",
+		   (unsigned long) sizeof(TransformElement), (unsigned long) sizeof(DataFilter), (unsigned long) sizeof(Deadzone),
+		   (unsigned long) sizeof(DataHandler), (unsigned long) sizeof(TrimHandler), (unsigned long) sizeof(Modifier),
+		   (unsigned long) sizeof(NoiseStats));
+	printf("sizeof : SensorPipeline %lu, Axis %lu, Potentiometer %lu, 4 Axis + 3 Potentiometer %lu\n",
+		   (unsigned long) sizeof(SensorPipeline), (unsigned long) sizeof(Axis), (unsigned long) sizeof(Potentiometer),
+		   (unsigned long)(sizeof(axes) + sizeof(pots)));
+
+	// Pipelines
+	axes[0].get_trim_handler_ptr()->set_offset(3);
+	axes[0].get_modifier_ptr()->set_expo(30);
+	double axis_ticks = time_sensor(&axes[0], samples);
+	double pot_ticks = time_sensor(&pots[0], samples);
+	printf("Host ticks per sample (set_adc_result + update_result, best batch) : %.1f (Axis), %.1f (Potentiometer)\n", axis_ticks,
+		   pot_ticks);
+
+	// Single elements
+	Candidate candidates[] = {
+		{"DataFilter", &data_filter},
+		{"Deadzone", &deadzone},
+		{"DataHandler", &data_handler},
+		{"TrimHandler", &trim},
+		{"Modifier", &modifier},
+		{"EmaFilter<2>", &ema},
+	};
+	printf("%-13s | %10s\n", "element", "ticks/call");
+	for(uint8_t c = 0; c < sizeof(candidates) / sizeof(candidates[0]); c++)
+	{
+		volatile int16_t sink = 0;
+		TransformElement* element = candidates[c].element;
+		uint64_t start = sim_host_ticks();
+		for(uint32_t n = 0; n < samples; n++) sink += element->compute(400 + (n & 255));
+		printf("%-13s | %10.1f\n", candidates[c].name, (double)(sim_host_ticks() - start) / samples);
+	}
+	return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * filter_bench
+ * Host program (see Host_simulation/Readme.md) comparing the filter elements which can be plugged into a sensor pipeline :
+ * DataFilter (3 samples moving average, division by 3), power of two MovingAverage, EmaFilter, IirFilter and MedianFilter.
+ * Reports for each one :
+ *  -> host ticks per compute() call (through TransformElement*, as the pipeline calls it)
+ *  -> lag : samples needed to reach 90 % of a 0 -> 1000 step, steady state delay on a 1 LSB / sample ramp
+ *  -> noise : residual standard deviation of a constant input + uniform noise of +/- 16 LSB, and the noise gain (output over
+ *     input variance, Q8) measured on it against the one the element declares (get_noise_gain(), for gaussian noise)
+ *  -> spikes : constant input with a single sample spike of +300 LSB every 50 samples, worst output error and number
+ *     of output samples disturbed per spike
+ *  -> size of the element
+ * Then checks NoiseStats against a floating point computation, and the deadzone sized by Axis::measure_noise() : the output
+ * of an axis at rest (noisy input) must not move, its neutral value is the rest position, it is sized over the filter installed
+ * by set_filter() and stays inside the input space for a rest position at its end.
+ *
+ * Usage : filter_bench [calls]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <avr/io.h>
+#include "Sensors.h"
+
+static uint32_t noise_state = 12345;
+static int16_t noise(int16_t amplitude)
+{
+	noise_state = noise_state * 1103515245 + 12345;
+	return (int16_t)((noise_state >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+// Resets the filter state to a given value (init_filter is not part of TransformElement)
+template<typename Filter>
+static void reset(TransformElement* element, int16_t value) {static_cast<Filter*>(element)->init_filter(value);}
+
+struct Candidate {
+	const char* name;
+	TransformElement* element;
+	void (*init)(TransformElement*, int16_t);
+	unsigned size;
+};
+
+DataFilter data_filter;
+MovingAverage<4> average_4;
+MovingAverage<16> average_16;
+MovingAverage<64> average_64;
+EmaFilter<2> ema_2;
+EmaFilter<4> ema_4;
+IirFilter iir;
+MedianFilter<3> median_3;
+MedianFilter<5> median_5;
+MedianFilter<9> median_9;
+MedianFilter<15> median_15;
+
+int main(int argc, char** argv)
+{
+	uint32_t calls = 2000000;
+	if(argc > 1) calls = atoi(argv[1]);
+	Candidate candidates[] = {
+		{"DataFilter (3)", &data_filter, reset<DataFilter>, sizeof(data_filter)},
+		{"MovingAverage<4>", &average_4, reset<MovingAverage<4> >, sizeof(average_4)},
+		{"MovingAverage<16>", &average_16, reset<MovingAverage<16> >, sizeof(average_16)},
+		{"MovingAverage<64>", &average_64, reset<MovingAverage<64> >, sizeof(average_64)},
+		{"EmaFilter<2>", &ema_2, reset<EmaFilter<2> >, sizeof(ema_2)},
+		{"EmaFilter<4>", &ema_4, reset<EmaFilter<4> >, sizeof(ema_4)},
+		{"IirFilter", &iir, reset<IirFilter>, sizeof(iir)},
+		{"MedianFilter<3>", &median_3, reset<MedianFilter<3> >, sizeof(median_3)},
+		{"MedianFilter<5>", &median_5, reset<MedianFilter<5> >, sizeof(median_5)},
+		{"MedianFilter<9>", &median_9, reset<MedianFilter<9> >, sizeof(median_9)},
+		{"MedianFilter<15>", &median_15, reset<MedianFilter<15> >, sizeof(median_15)},
+	};
+	uint8_t nb = sizeof(candidates) / sizeof(candidates[0]);
+
+	printf("%-18s | %10s | %12s | %13s | %11s | %15s | %16s | %5s\n", "filter", "ticks/call", "step 90 % in", "ramp delay",
+		   "noise sigma", "gain (declared)", "spike err / len", "bytes");
+	const double input_variance = (33.0 * 33.0 - 1) / 12;	// Uniform noise of +/- 16 LSB
+	for(uint8_t c = 0; c < nb; c++)
+	{
+		Candidate* f = &candidates[c];
+		// Step response
+		f->init(f->element, 0);
+		uint16_t step_samples = 0;
+		while(step_samples < 1000 && f->element->compute(1000) < 900) step_samples++;
+		step_samples++;
+		// Ramp : steady state difference between input and output
+		f->init(f->element, 0);
+		int16_t output = 0;
+		for(int16_t n = 0; n < 1000; n++) output = f->element->compute(n);
+		int16_t ramp_delay = 999 - output;
+		// Noise
+		f->init(f->element, 512);
+		double square_sum = 0;
+		for(uint32_t n = 0; n < 100000; n++) {
+			int16_t deviation = f->element->compute(512 + noise(16)) - 512;
+			square_sum += (double) deviation * deviation;
+		}
+		// Spikes
+		f->init(f->element, 512);
+		int16_t spike_error = 0;
+		uint32_t disturbed = 0;
+		for(uint32_t n = 0; n < 5000; n++) {
+			int16_t error = f->element->compute(n % 50 == 25 ? 812 : 512) - 512;
+			if(error < 0) error = -error;
+			if(error > spike_error) spike_error = error;
+			if(error > 2) disturbed++;
+		}
+		// Timing
+		f->init(f->element, 512);
+		volatile int16_t sink = 0;	// Keeps the calls alive
+		uint64_t start = sim_host_ticks();
+		for(uint32_t n = 0; n < calls; n++) sink += f->element->compute(512 + (n & 15));
+		uint64_t ticks = sim_host_ticks() - start;
+		printf("%-18s | %10.1f | %4u samples | %5d samples | %11.2f | %5.0f (%5u) | %6d / %4.1f sp | %5u\n", f->name,
+			   (double) ticks / calls, step_samples, ramp_delay, sqrt(square_sum / 100000),
+			   256 * square_sum / 100000 / input_variance, f->element->get_noise_gain(), spike_error, disturbed / 100.0, f->size);
+	}
+
+	// The same elements plugged into a sensor pipeline
+	Axis axis;
+	EmaFilter<2> axis_ema;
+	EmaFilter<2> reference;
+	uint32_t mismatches = 0;
+	if(axis.set_filter(&axis_ema)) {
+		for(uint32_t n = 0; n < 10000; n++) {
+			int16_t value = 512 + noise(300);
+			axis.set_adc_result(value);
+			axis.update_result();
+			if(axis.read_sensor() != axis.get_data_handler_ptr()->compute(axis.get_deadzone_ptr()->compute(reference.compute(value))))
+				mismatches++;
+		}
+		printf("\nAxis::set_filter(EmaFilter<2>) : %u mismatches against the standalone chain\n", mismatches);
+	}
+	else printf("\nAxis::set_filter() is not available with the static pipeline\n");
+
+	// Noise measurement, stick at rest around 530
+	const int16_t amplitudes[] = {0, 1, 4, 16};
+	printf("\n%-9s | %-24s | %-24s | %-17s | %-9s | %s\n", "noise", "mean / sigma (exact)", "mean / sigma (NoiseStats)",
+		   "deadzone (neut.)", "suggested", "output changes at rest");
+	uint8_t wrong_neutral = 0;
+	for(uint8_t a = 0; a < sizeof(amplitudes) / sizeof(amplitudes[0]); a++)
+	{
+		Axis rest_axis;
+		rest_axis.measure_noise(1);
+		double sum = 0, square_sum = 0;
+		for(uint16_t n = 0; n < NOISE_STATS_SAMPLES; n++) {
+			int16_t value = 530 + noise(amplitudes[a]);
+			sum += value;
+			square_sum += (double) value * value;
+			rest_axis.set_adc_result(value);
+			rest_axis.update_result();
+		}
+		NoiseStats* stats = rest_axis.get_noise_stats_ptr();
+		int16_t mean = stats->get_mean();
+		double sigma = stats->get_std_dev() / 16.0;
+		rest_axis.measure_noise(0);
+		Deadzone* deadzone = rest_axis.get_deadzone_ptr();
+		uint32_t changes = 0;
+		int16_t last = 0;
+		for(uint32_t n = 0; n < 10000; n++) {
+			rest_axis.set_adc_result(530 + noise(amplitudes[a]));
+			rest_axis.update_result();
+			if(n > 0 && rest_axis.read_sensor() != last) changes++;
+			last = rest_axis.read_sensor();
+		}
+		double exact_mean = sum / NOISE_STATS_SAMPLES;
+		if(deadzone->get_deadzone_neutral() != mean) wrong_neutral = 1;
+		printf("+/- %-5d | %8.2f / %-13.3f | %8d / %-14.3f | [%d ; %d] (%d) | %9u | %u / 10000%s\n", amplitudes[a], exact_mean,
+			   sqrt(square_sum / NOISE_STATS_SAMPLES - exact_mean * exact_mean), mean, sigma, deadzone->get_deadzone_min(),
+			   deadzone->get_deadzone_max(), deadzone->get_deadzone_neutral(), rest_axis.suggest_filter_size(), changes,
+			   rest_axis.is_bypassed(TransformElement::DFilter) ? " (filter bypassed)" : "");
+	}
+	if(wrong_neutral) printf("Deadzone neutral value NOT SET TO THE REST POSITION\n");
+
+	// Deadzone sized over the filter installed by set_filter() : 3 sigma of the EmaFilter<3> output, not of the DataFilter one
+	Axis ema_axis;
+	EmaFilter<3> rest_ema;
+	uint8_t wrong_width = 0;
+	if(ema_axis.set_filter(&rest_ema)) {
+		ema_axis.measure_noise(1);
+		for(uint16_t n = 0; n < NOISE_STATS_SAMPLES; n++) {
+			ema_axis.set_adc_result(530 + noise(16));
+			ema_axis.update_result();
+		}
+		NoiseStats* stats = ema_axis.get_noise_stats_ptr();
+		uint16_t expected = (3 * (uint32_t) stats->get_filtered_std_dev(rest_ema.get_noise_gain()) + 15) / 16 + 1;
+		uint16_t data_filter_width = (3 * (uint32_t) stats->get_std_dev(DATA_FILTER_SIZE) + 15) / 16 + 1;
+		ema_axis.measure_noise(0);
+		Deadzone* deadzone = ema_axis.get_deadzone_ptr();
+		uint16_t half_width = (deadzone->get_deadzone_max() - deadzone->get_deadzone_min()) / 2;
+		wrong_width = half_width != expected;
+		printf("\nEmaFilter<3> installed, +/- 16 noise : deadzone half width %u (expected %u, %u with the DataFilter)%s\n", half_width,
+			   expected, data_filter_width, wrong_width ? " WRONG" : "");
+	}
+
+	// Rest position at the end of the input space : the deadzone is clamped to it
+	Axis end_axis;
+	end_axis.measure_noise(1);
+	for(uint16_t n = 0; n < NOISE_STATS_SAMPLES; n++) {
+		int16_t value = 1 + noise(4);
+		end_axis.set_adc_result(value < 0 ? 0 : value);
+		end_axis.update_result();
+	}
+	end_axis.measure_noise(0);
+	Deadzone* end_deadzone = end_axis.get_deadzone_ptr();
+	uint8_t clamped = end_deadzone->get_deadzone_min() == 0 && end_deadzone->get_deadzone_max() < 64;
+	printf("\nRest position at 1 : deadzone [%d ; %d] %s\n", end_deadzone->get_deadzone_min(), end_deadzone->get_deadzone_max(),
+		   clamped ? "(clamped)" : "(OUT OF THE INPUT SPACE)");
+	return mismatches != 0 || !clamped || wrong_neutral || wrong_width;
+}
@@ -0,0 +1,121 @@
+/*
+ * paired_bench
+ * Host program (see Host_simulation/Readme.md) comparing independent X / Y requests with paired requests
+ * (Gimbal::set_paired_requests, Adc group requests) on the Pots_and_Axis_implementation.cpp workload :
+ * 2 Gimbals and 3 Potentiometers sharing one Adc, same main loop. Reports for both modes :
+ *  -> X / Y skew : time between the end of the X conversion and the end of the Y conversion of the pair the Gimbal
+ *     outputs after update_sensors() (average and worst)
+ *  -> pairs/s : update_sensors() calls which gave a new X / Y pair, samples/s of the pots
+ *  -> conversions/s and host ticks spent in Adc::handle_conversion per conversion
+ *
+ * Usage : paired_bench [main_loop_cycles] [simulated_seconds]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "adc_tools.h"
+#include "Sensors.h"
+
+#define SENSOR_NB 7
+
+Adc adc;
+// One set of sensors per mode (handlers quotas are not reset by Adc::initialize)
+Gimbal gimbals[2][2];
+Potentiometer pots[2][3];
+AnalogSensor* sensors[SENSOR_NB];
+
+uint64_t conversion_end[SENSOR_NB];	// cpu cycle of the last conversion of each sensor
+uint32_t converted[SENSOR_NB];
+uint64_t isr_ticks = 0;
+
+static uint8_t sensor_index(AnalogSensor* sensor)
+{
+	for(uint8_t i = 0; i < SENSOR_NB; i++) if(sensors[i] == sensor) return i;
+	return SENSOR_NB;
+}
+
+ISR(ADC_vect){
+	uint8_t index = sensor_index(adc.get_current_sensor_id());	// Sensor whose conversion has just ended
+	uint64_t start = sim_host_ticks();
+	adc.handle_conversion();
+	isr_ticks += sim_host_ticks() - start;
+	if(index >= SENSOR_NB) return;
+	conversion_end[index] = sim_adc.get_cycles();
+	converted[index]++;
+}
+
+static void run(uint8_t paired, uint32_t loop_cycles, double duration)
+{
+	Gimbal* g = gimbals[paired];
+	Potentiometer* p = pots[paired];
+	for(uint8_t i = 0; i < 2; i++) {
+		g[i].set_adc_muxes(2 * i, 2 * i + 1);
+		g[i].set_paired_requests(paired);
+		sensors[2 * i] = g[i].get_x_axis_ptr();
+		sensors[2 * i + 1] = g[i].get_y_axis_ptr();
+	}
+	for(uint8_t i = 0; i < 3; i++) {
+		p[i].set_adc_mux(4 + i);
+		sensors[4 + i] = &p[i];
+	}
+	for(uint8_t i = 0; i < SENSOR_NB; i++) {
+		conversion_end[i] = 0;
+		converted[i] = 0;
+		sim_adc.set_input(i, 100 * (i + 1));
+	}
+	isr_ticks = 0;
+	sim_adc.reset();
+	sim_adc.set_isr_cycles(60);
+	adc.initialize();
+	sei();
+
+	uint32_t pairs = 0;
+	uint64_t skew_sum = 0, skew_max = 0;
+	uint64_t end = (uint64_t)(duration * F_CPU);
+	while(sim_adc.get_cycles() < end)
+	{
+		for(uint8_t i = 0; i < 2; i++) g[i].send_adc_requests(&adc);
+		for(uint8_t i = 0; i < 2; i++) {
+			uint16_t x_stamp = g[i].get_x_axis_ptr()->get_sample_stamp();
+			uint16_t y_stamp = g[i].get_y_axis_ptr()->get_sample_stamp();
+			g[i].update_sensors();
+			if(g[i].get_x_axis_ptr()->get_sample_stamp() == x_stamp && g[i].get_y_axis_ptr()->get_sample_stamp() == y_stamp) continue;
+			if(!converted[2 * i] || !converted[2 * i + 1]) continue;
+			uint64_t x_end = conversion_end[2 * i], y_end = conversion_end[2 * i + 1];
+			uint64_t skew = x_end > y_end ? x_end - y_end : y_end - x_end;
+			skew_sum += skew;
+			if(skew > skew_max) skew_max = skew;
+			pairs++;
+		}
+		for(uint8_t i = 0; i < 3; i++) p[i].send_adc_request(&adc);
+		for(uint8_t i = 0; i < 3; i++) p[i].update_result();
+		sim_adc.run(loop_cycles);
+	}
+	cli();
+
+	double seconds = sim_adc.cycles_to_seconds(sim_adc.get_cycles());
+	double us_per_cycle = 1e6 / F_CPU;
+	printf("%-11s | %7.1f / %-8.1f | %8.0f | %8.0f | %10.0f | %.1f\n", paired ? "paired" : "independent",
+		   pairs ? us_per_cycle * skew_sum / pairs : 0.0, us_per_cycle * skew_max, pairs / seconds,
+		   (converted[4] + converted[5] + converted[6]) / seconds, sim_adc.get_conversion_nb() / seconds,
+		   (double) isr_ticks / sim_adc.get_conversion_nb());
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t loop_cycles = 400;
+	double duration = 1.0;
+	if(argc > 1) loop_cycles = atoi(argv[1]);
+	if(argc > 2) duration = atof(argv[2]);
+	printf("main loop = %u cycles, %.1f simulated s\n", loop_cycles, duration);
+	printf("%-11s | %-19s | %-8s | %-8s | %-10s | %s\n", "requests", "X/Y skew us avg/max", "pairs/s", "pots/s", "conv/s",
+		   "ISR host ticks / conversion");
+	run(0, loop_cycles, duration);
+	run(1, loop_cycles, duration);
+	return 0;
+}
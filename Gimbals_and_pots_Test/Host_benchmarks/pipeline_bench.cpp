@@ -0,0 +1,174 @@
+/*
+ * pipeline_bench
+ * Host program (see Host_simulation/Readme.md) checking the incremental recomputation of the sensor pipeline
+ * (SensorPipeline : TransformPipeline, StaticPipeline with -DSTATIC_TRANSFORM_PIPELINE or SharedPipeline with
+ * -DSHARED_PIPELINE_TOPOLOGY) on an Axis chain
+ * DataFilter -> Deadzone -> DataHandler -> TrimHandler -> Modifier :
+ *  -> exactness : held and changing inputs (a few of them out of the adc range), while trims, deadzone, ranges, expo and
+ *     bypasses are changed at random ; every output must match a reference chain computed stage by stage without any
+ *     memoization nor fusion (DataHandler + TrimHandler are fused while the Modifier is bypassed)
+ *  -> AnalogSensor::set_filter() once the pipeline is built : the new filter is attached to the pipeline (the previous
+ *     one detached) and the outputs match a sensor given the same filter before its first sample
+ *  -> host ticks per transform() : held input (only the filter is computed), changing input, and right after a trim step
+ *
+ * Usage : pipeline_bench [samples]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include "Sensors.h"
+
+struct Chain {
+	DataFilter filter;
+	Deadzone deadzone;
+	DataHandler data_handler;
+	TrimHandler trim;
+	Modifier modifier;
+	TransformElement* stages[5];
+	SensorPipeline pipe;	// In the same object as the elements (SharedPipeline locates them by offset)
+	Chain() {
+		stages[0] = &filter;
+		stages[1] = &deadzone;
+		stages[2] = &data_handler;
+		stages[3] = &trim;
+		stages[4] = &modifier;
+	}
+	// Reference : every stage, every time
+	int16_t compute(int16_t input) {
+		for(uint8_t i = 0; i < 5; i++) if(!stages[i]->is_bypassed()) input = stages[i]->compute(input);
+		return input;
+	}
+};
+
+// Tells whether the filter reports its changes to a pipeline
+struct ProbedAverage : MovingAverage<4> {
+	uint8_t is_attached() {return stale_stage != NULL;}
+};
+
+Chain chain;
+Chain reference;
+SensorPipeline& pipe = chain.pipe;
+#ifdef SHARED_PIPELINE_TOPOLOGY
+PipelineTopology topology;
+#endif
+
+static uint32_t noise_state = 12345;
+static uint16_t random_value(uint16_t range)
+{
+	noise_state = noise_state * 1103515245 + 12345;
+	return (noise_state >> 16) % range;
+}
+
+// Same random configuration change on both chains
+static void random_change()
+{
+	uint16_t value = random_value(1024);
+	switch(random_value(7)) {
+		case 0 :
+			chain.trim.step_up();
+			reference.trim.step_up();
+			break;
+		case 1 :
+			chain.trim.step_down();
+			reference.trim.step_down();
+			break;
+		case 2 :
+			chain.deadzone.set_ranges(value / 2, value / 2 + 60);
+			reference.deadzone.set_ranges(value / 2, value / 2 + 60);
+			break;
+		case 3 :
+			chain.data_handler.set_ranges(value / 8, 1023 - value / 8, -100, 100);
+			reference.data_handler.set_ranges(value / 8, 1023 - value / 8, -100, 100);
+			break;
+		case 4 :
+			chain.modifier.set_expo(value % 101);
+			reference.modifier.set_expo(value % 101);
+			break;
+		default : {
+			uint8_t stage = 1 + value % 4;	// Filter bypass would desynchronize the filter states
+			uint8_t byp = !chain.stages[stage]->is_bypassed();
+			chain.stages[stage]->set_bypass(byp);
+			reference.stages[stage]->set_bypass(byp);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t samples = 1000000;
+	if(argc > 1) samples = atoi(argv[1]);
+#ifdef STATIC_TRANSFORM_PIPELINE
+	pipe.set_elements(NULL, &chain.filter, &chain.deadzone, &chain.data_handler, &chain.trim, &chain.modifier);
+	printf("StaticPipeline\n");
+#elif defined(SHARED_PIPELINE_TOPOLOGY)
+	for(uint8_t i = 0; i < 5; i++) topology.add_stage(&pipe, chain.stages[i]);
+	pipe.set_topology(&topology);
+	printf("SharedPipeline\n");
+#else
+	for(uint8_t i = 0; i < 5; i++) pipe.add_element(chain.stages[i]);
+	printf("TransformPipeline\n");
+#endif
+
+	// Exactness
+	uint32_t mismatches = 0;
+	int16_t input = 512;
+	for(uint32_t n = 0; n < samples; n++)
+	{
+		if(random_value(4) == 0) input = random_value(1400) - 200;	// Inputs are held most of the time
+		if(random_value(16) == 0) random_change();
+		int16_t output = pipe.transform(input);
+		int16_t expected = reference.compute(input);
+		if(output != expected) {
+			if(mismatches < 10) printf("mismatch : sample %u input %d -> %d, expected %d\n", n, input, output, expected);
+			mismatches++;
+		}
+	}
+	printf("Exactness : %u samples, %u mismatches\n", samples, mismatches);
+
+	// Filter replaced on a running sensor
+	uint8_t filter_ok = 1;
+#ifndef STATIC_TRANSFORM_PIPELINE
+	Axis late_axis, early_axis;
+	ProbedAverage late_filter, early_filter;
+	early_axis.set_filter(&early_filter);
+	uint32_t filter_mismatches = 0;
+	for(uint16_t n = 0; n < 1000; n++) {
+		if(n == 100) filter_ok = late_axis.set_filter(&late_filter) && late_filter.is_attached();
+		if(n == 900) filter_ok = filter_ok && late_axis.set_filter(NULL) && !late_filter.is_attached();
+		uint16_t raw = random_value(1024);
+		late_axis.set_adc_result(raw);
+		early_axis.set_adc_result(raw);
+		late_axis.update_result();
+		early_axis.update_result();
+		if(n >= 104 && n < 900 && late_axis.read_sensor() != early_axis.read_sensor()) filter_mismatches++;
+	}
+	filter_ok = filter_ok && filter_mismatches == 0;
+	printf("set_filter() on a running Axis : %u mismatches, new filter %s\n", filter_mismatches,
+		   filter_ok ? "attached" : "NOT ATTACHED");
+#endif
+
+	// Timing
+	chain.modifier.set_bypass(0);
+	volatile int16_t sink = 0;	// Keeps the calls alive
+	uint64_t start = sim_host_ticks();
+	for(uint32_t n = 0; n < samples; n++) sink += pipe.transform(600);
+	uint64_t held = sim_host_ticks() - start;
+	start = sim_host_ticks();
+	for(uint32_t n = 0; n < samples; n++) sink += pipe.transform(600 + (n & 63));
+	uint64_t changing = sim_host_ticks() - start;
+	uint64_t trimmed = 0;
+	for(uint32_t n = 0; n < samples; n++) {
+		if(n & 1) chain.trim.step_up();
+		else chain.trim.step_down();
+		start = sim_host_ticks();
+		sink += pipe.transform(600);
+		trimmed += sim_host_ticks() - start;
+	}
+	printf("Host ticks per transform() : %.1f (held input), %.1f (changing input), %.1f (held input after a trim step)\n",
+		   (double) held / samples, (double) changing / samples, (double) trimmed / samples);
+	return mismatches != 0 || !filter_ok;
+}
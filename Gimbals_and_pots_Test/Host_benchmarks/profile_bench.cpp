@@ -0,0 +1,101 @@
+/*
+ * profile_bench
+ * Host program (see Host_simulation/Readme.md) running the workload of Pots_and_Axis_implementation.cpp (2 paired Gimbals,
+ * 3 Potentiometers, same settings and main loop) on the simulated ADC with noisy inputs, then dumping the CycleProfiler table
+ * (Profiler.h) : count, min, max and mean host ticks per site. Build it with -DCYCLE_PROFILER (and -DSTATIC_TRANSFORM_PIPELINE,
+ * -DSHARED_PIPELINE_TOPOLOGY or -DTAGGED_ELEMENT_DISPATCH to profile the other pipelines).
+ *
+ * Usage : profile_bench [main_loop_cycles] [simulated_seconds]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "adc_tools.h"
+#include "Sensors.h"
+#include "Profiler.h"
+
+// Same tables as Pots_and_Axis_implementation.cpp
+constexpr GimbalConfig left_config PROGMEM = {
+	{ADC0D, 0, 1023, -100, 100, 480, 550, (480 + 550)/2, AXIS_DEFAULT_BYPASS, 0, 0},
+	{ADC1D, 0, 1023, -100, 100, 460, 620, (460 + 620)/2, AXIS_DEFAULT_BYPASS, 0, 0},
+	0, 0
+};
+constexpr GimbalConfig right_config PROGMEM = {
+	{ADC2D, 0, 1023, -100, 100, 510, 514, 512, AXIS_DEFAULT_BYPASS, 0, 0},
+	{ADC3D, 0, 1023, -100, 100, 512, 512, 512, AXIS_DEFAULT_BYPASS | SENSOR_BYPASS(DZone), 0, 0},
+	0, 0
+};
+constexpr SensorConfig pot_configs[3] PROGMEM = {
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+};
+
+Adc adc;
+Potentiometer pot1(&pot_configs[0]), pot2(&pot_configs[1]), pot3(&pot_configs[2]);
+Gimbal left_g(&left_config), right_g(&right_config);
+
+ISR(ADC_vect){
+	adc.handle_conversion();
+}
+
+#ifdef CYCLE_PROFILER
+static void put_char(char c) {putchar(c);}
+#endif
+
+int main(int argc, char** argv)
+{
+	uint32_t loop_cycles = 400;
+	double duration = 1.0;
+	if(argc > 1) loop_cycles = atoi(argv[1]);
+	if(argc > 2) duration = atof(argv[2]);
+#ifndef CYCLE_PROFILER
+	(void) loop_cycles;
+	(void) duration;
+	printf("Build with -DCYCLE_PROFILER to profile the hot path\n");
+	return 0;
+#else
+	sim_adc.reset();
+	sim_adc.set_isr_cycles(60);
+	adc.initialize();
+	profiler.initialize();
+	sei();
+
+	// Sticks and pots slowly moving around their centre, plus +/- 2 LSB of noise
+	uint32_t noise_state = 12345;
+	uint64_t end = (uint64_t)(duration * F_CPU);
+	uint32_t loops = 0;
+	while(sim_adc.get_cycles() < end)
+	{
+		for(uint8_t channel = 0; channel < 7; channel++) {
+			noise_state = noise_state * 1103515245 + 12345;
+			int16_t drift = (int16_t)((loops / 64 + 40 * channel) % 200) - 100;
+			sim_adc.set_input(channel, 512 + drift + (int16_t)((noise_state >> 16) % 5) - 2);
+		}
+		left_g.send_adc_requests(&adc);
+		right_g.send_adc_requests(&adc);
+		left_g.update_sensors();
+		right_g.update_sensors();
+		pot1.send_adc_request(&adc);
+		pot2.send_adc_request(&adc);
+		pot3.send_adc_request(&adc);
+		pot1.update_result();
+		pot2.update_result();
+		pot3.update_result();
+		sim_adc.run(loop_cycles);
+		loops++;
+	}
+	cli();
+
+	printf("main loop = %u cycles, %.1f simulated s, %u conversions, probe overhead %u host ticks (subtracted)\n", loop_cycles, duration,
+		   sim_adc.get_conversion_nb(), (unsigned) profiler.get_overhead());
+	profiler.dump(put_char);
+	ProfileStats transform_stats;
+	return !profiler.get_stats(CycleProfiler::Transform, &transform_stats);
+#endif
+}
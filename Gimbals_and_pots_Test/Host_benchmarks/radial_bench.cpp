@@ -0,0 +1,144 @@
+/*
+ * radial_bench
+ * Host program (see Host_simulation/Readme.md) checking the 2D stage of the Gimbal (RadialDeadzone) :
+ *  -> accuracy : every (x, y) of [-140 ; 140]^2 against the floating point formula (radial deadzone + circle to square mapping),
+ *     for a few radii of a [-100 ; 100] output
+ *  -> Gimbal in radial mode : stick at rest gives the trim offsets, bypass states of the axes restored when leaving it
+ *  -> Gimbal(Axis&, Axis&) : the copied axes give the outputs of their sources and don't share their elements with them
+ *  -> host ticks per Gimbal::update_sensors() (one new X / Y pair), square deadzones vs radial mode
+ *
+ * Usage : radial_bench [pairs]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <avr/io.h>
+#include "Sensors.h"
+
+Gimbal square_gimbal;
+Gimbal radial_gimbal;
+Gimbal trimmed_gimbal;
+Axis source_x;
+Axis source_y;
+
+static uint32_t noise_state = 12345;
+static uint16_t random_sample()
+{
+	noise_state = noise_state * 1103515245 + 12345;
+	return (noise_state >> 16) % 1024;
+}
+
+static uint64_t time_gimbal(Gimbal* gimbal, uint32_t pairs)
+{
+	volatile int16_t sink = 0;	// Keeps the reads alive
+	noise_state = 12345;
+	uint64_t ticks = 0;
+	for(uint32_t n = 0; n < pairs; n++) {
+		gimbal->x_axis.set_adc_result(random_sample());
+		gimbal->y_axis.set_adc_result(random_sample());
+		uint64_t start = sim_host_ticks();
+		gimbal->update_sensors();
+		ticks += sim_host_ticks() - start;
+		sink += gimbal->read_x_axis() + gimbal->read_y_axis();
+	}
+	return ticks;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t pairs = 200000;
+	if(argc > 1) pairs = atoi(argv[1]);
+
+	// Accuracy
+	const int16_t radii[] = {0, 5, 20, 50};
+	int16_t worst = 0;
+	printf("%-6s | %-9s | %-12s | %-15s | %s\n", "radius", "worst err", "points off", "(71, 71) ->", "(30, 30) ->");
+	for(uint8_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++)
+	{
+		RadialDeadzone radial;
+		radial.set_ranges(0, 100, radii[r]);
+		int16_t radius_worst = 0;
+		uint32_t off = 0;
+		for(int16_t x = -140; x <= 140; x++)
+			for(int16_t y = -140; y <= 140; y++) {
+				int16_t out_x = x, out_y = y;
+				radial.compute(&out_x, &out_y);
+				double distance = sqrt((double) x * x + (double) y * y);
+				double high = fabs(x) > fabs(y) ? fabs(x) : fabs(y);
+				double exact_x = 0, exact_y = 0;
+				if(distance > radii[r]) {
+					double scale = (distance - radii[r]) / high * 100.0 / (100 - radii[r]);
+					exact_x = fmin(100, fmax(-100, x * scale));
+					exact_y = fmin(100, fmax(-100, y * scale));
+				}
+				int16_t error = (int16_t) fmax(fabs(out_x - round(exact_x)), fabs(out_y - round(exact_y)));
+				if(error > radius_worst) radius_worst = error;
+				if(error) off++;
+			}
+		int16_t diag_x = 71, diag_y = 71, small_x = 30, small_y = 30;
+		radial.compute(&diag_x, &diag_y);
+		radial.compute(&small_x, &small_y);
+		printf("%-6d | %5d LSB | %5u / %u | (%4d, %4d)    | (%4d, %4d)\n", radii[r], radius_worst, off, 281 * 281, diag_x, diag_y,
+			   small_x, small_y);
+		if(radius_worst > worst) worst = radius_worst;
+	}
+
+	// Radial stage before the trims : the stick at rest gives the trim offsets
+	Axis* x_axis = trimmed_gimbal.get_x_axis_ptr();
+	Axis* y_axis = trimmed_gimbal.get_y_axis_ptr();
+	y_axis->set_bypass(TransformElement::DZone, 1);
+	x_axis->set_bypass(TransformElement::TrimH, 0);
+	y_axis->set_bypass(TransformElement::TrimH, 0);
+	x_axis->get_trim_handler_ptr()->set_offset(7);
+	y_axis->get_trim_handler_ptr()->set_offset(-7);
+	trimmed_gimbal.set_radial_deadzone(10);
+	for(uint8_t n = 0; n < 8; n++) {	// Fills the filters
+		x_axis->set_adc_result(512);
+		y_axis->set_adc_result(512);
+		trimmed_gimbal.update_sensors();
+	}
+	int16_t rest_x = trimmed_gimbal.read_x_axis(), rest_y = trimmed_gimbal.read_y_axis();
+	uint8_t rest_ok = rest_x == 7 && rest_y == -7;
+	trimmed_gimbal.set_radial_deadzone(0, 0);
+	uint8_t restored = !x_axis->is_bypassed(TransformElement::DZone) && y_axis->is_bypassed(TransformElement::DZone) &&
+					   !x_axis->is_bypassed(TransformElement::TrimH) && x_axis->is_bypassed(TransformElement::Mod);
+	printf("\nRadial mode, stick at rest : (%d, %d) for trims (7, -7) %s, bypass states %s\n", rest_x, rest_y, rest_ok ? "ok" : "WRONG", restored ? "restored" : "NOT RESTORED");
+
+	// Copied axes : same outputs as the sources, then a deadzone set on the copy only changes the copy
+	source_x.set_deadzone(480, 550, (480 + 550) / 2, 0);
+	Gimbal copied_gimbal(source_x, source_y);
+	uint32_t copy_mismatches = 0, x_changes = 0;
+	noise_state = 12345;
+	for(uint16_t n = 0; n < 1000; n++) {
+		uint16_t x = random_sample(), y = random_sample();
+		if(n == 500) copied_gimbal.get_x_axis_ptr()->set_deadzone(0, 0, 0, 1);
+		source_x.set_adc_result(x);
+		source_y.set_adc_result(y);
+		copied_gimbal.x_axis.set_adc_result(x);
+		copied_gimbal.y_axis.set_adc_result(y);
+		source_x.update_result();
+		source_y.update_result();
+		copied_gimbal.update_sensors();
+		uint8_t x_differs = copied_gimbal.read_x_axis() != source_x.read_sensor();
+		if(n >= 500) x_changes += x_differs;
+		else copy_mismatches += x_differs;
+		copy_mismatches += copied_gimbal.read_y_axis() != source_y.read_sensor();
+	}
+	uint8_t copy_ok = copy_mismatches == 0 && x_changes != 0 && !source_x.is_bypassed(TransformElement::DZone);
+	printf("Gimbal(Axis&, Axis&) : %u mismatches over 1000 pairs, %u X outputs changed by the deadzone of the copy, source deadzone %s\n",
+		   copy_mismatches, x_changes, source_x.is_bypassed(TransformElement::DZone) ? "CHANGED" : "kept");
+
+	// Timing
+	square_gimbal.get_x_axis_ptr()->set_deadzone(480, 550, (480 + 550) / 2, 0);
+	square_gimbal.get_y_axis_ptr()->set_deadzone(460, 620, (460 + 620) / 2, 0);
+	radial_gimbal.set_radial_deadzone(10);
+	uint64_t square_ticks = time_gimbal(&square_gimbal, pairs);
+	uint64_t radial_ticks = time_gimbal(&radial_gimbal, pairs);
+	printf("\nHost ticks per Gimbal::update_sensors() : %.1f (square deadzones), %.1f (radial mode)\n",
+		   (double) square_ticks / pairs, (double) radial_ticks / pairs);
+	return worst > 1 || !rest_ok || !restored || !copy_ok;
+}
@@ -0,0 +1,134 @@
+/*
+ * sensor_bank_bench
+ * Host program (see Host_simulation/Readme.md) comparing the SensorBank (structure of arrays) with the per object sensors
+ * of Pots_and_Axis_implementation.cpp (4 Axes + 3 Potentiometers, same deadzones) :
+ *  -> exactness : random samples are fed to both, read_sensor() must give the same values
+ *  -> host ticks of one update pass (7 x AnalogSensor::update_result vs SensorBank::update)
+ *  -> samples/s on the simulated ADC with bank rounds (one send_adc_requests call per main loop pass)
+ *  -> SRAM footprint of both (sizeof)
+ *
+ * Usage : sensor_bank_bench [samples] [main_loop_cycles]
+ *
+ * Author : bebenlebricolo
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "adc_tools.h"
+#include "Sensors.h"
+#include "SensorBank.h"
+
+#define SENSOR_NB 7
+
+Adc adc;
+Axis axes[4];
+Potentiometer pots[3];
+AnalogSensor* sensors[SENSOR_NB] = {&axes[0], &axes[1], &axes[2], &axes[3], &pots[0], &pots[1], &pots[2]};
+SensorBank bank;
+
+ISR(ADC_vect){
+	adc.handle_conversion();
+}
+
+static uint32_t noise_state = 12345;
+static uint16_t random_sample()
+{
+	noise_state = noise_state * 1103515245 + 12345;
+	return (noise_state >> 16) % 1024;
+}
+
+// Same settings on both sides
+static void configure()
+{
+	const int16_t dz[4][3] = {{480, 550, (480 + 550)/2}, {460, 620, (460 + 620)/2}, {510, 514, 512}, {512, 512, 512}};
+	for(uint8_t i = 0; i < SENSOR_NB; i++) bank.add_sensor(i);
+	for(uint8_t i = 0; i < 4; i++) {
+		axes[i].set_deadzone(dz[i][0], dz[i][1], dz[i][2], i == 3);
+		bank.set_deadzone(i, dz[i][0], dz[i][1], dz[i][2], i == 3);
+	}
+	// A few non default mappings
+	axes[1].set_ranges(100, 900, 0, 255);
+	bank.set_ranges(1, 100, 900, 0, 255);
+	axes[2].get_data_handler_ptr()->reverse(1);
+	bank.set_ranges(2, 0, 1023, -100, 100, 1);
+	pots[0].set_ranges(0, 1023, 0, 1000);
+	bank.set_ranges(4, 0, 1023, 0, 1000);
+	pots[2].set_bypass(TransformElement::DFilter, 1);
+	bank.set_bypass(6, TransformElement::DFilter, 1);
+	for(uint8_t i = 0; i < SENSOR_NB; i++) sensors[i]->set_adc_mux(i);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t samples = 200000;
+	uint32_t loop_cycles = 1500;
+	if(argc > 1) samples = atoi(argv[1]);
+	if(argc > 2) loop_cycles = atoi(argv[2]);
+	configure();
+
+	// Exactness
+	uint32_t mismatches = 0;
+	for(uint32_t n = 0; n < samples; n++)
+	{
+		for(uint8_t i = 0; i < SENSOR_NB; i++) {
+			uint16_t value = random_sample();
+			sensors[i]->set_adc_result(value);
+			sensors[i]->update_result();
+			bank.set_sample(i, value);
+		}
+		bank.round_complete(0);
+		bank.update();
+		for(uint8_t i = 0; i < SENSOR_NB; i++)
+			if(bank.read_sensor(i) != sensors[i]->read_sensor()) {
+				if(mismatches < 10) printf("mismatch : sensor %u sample %u -> object %d, bank %d\n", i, n,
+										   sensors[i]->read_sensor(), bank.read_sensor(i));
+				mismatches++;
+			}
+	}
+	printf("Exactness     : %u rounds of %d sensors, %u mismatches\n", samples, SENSOR_NB, mismatches);
+
+	// Update pass timing
+	uint64_t object_ticks = 0, bank_ticks = 0;
+	for(uint32_t n = 0; n < samples; n++)
+	{
+		for(uint8_t i = 0; i < SENSOR_NB; i++) {
+			uint16_t value = random_sample();
+			sensors[i]->set_adc_result(value);
+			bank.set_sample(i, value);
+		}
+		bank.round_complete(0);
+		uint64_t start = sim_host_ticks();
+		for(uint8_t i = 0; i < SENSOR_NB; i++) sensors[i]->update_result();
+		uint64_t middle = sim_host_ticks();
+		bank.update();
+		bank_ticks += sim_host_ticks() - middle;
+		object_ticks += middle - start;
+	}
+	printf("Update pass   : %.1f host ticks (7 x update_result) vs %.1f host ticks (SensorBank::update)\n",
+		   (double) object_ticks / samples, (double) bank_ticks / samples);
+	printf("SRAM          : %lu bytes (4 Axis + 3 Potentiometer) vs %lu bytes (SensorBank, SENSOR_BANK_SIZE = %d)\n",
+		   (unsigned long)(sizeof(axes) + sizeof(pots)), (unsigned long) sizeof(bank), SENSOR_BANK_SIZE);
+
+	// Simulated ADC : bank rounds
+	sim_adc.set_isr_cycles(80);
+	for(uint8_t i = 0; i < SENSOR_NB; i++) sim_adc.set_input(i, 100 * (i + 1));
+	adc.initialize();
+	sei();
+	uint32_t rounds = 0;
+	uint64_t end = 2 * F_CPU;
+	while(sim_adc.get_cycles() < end)
+	{
+		bank.send_adc_requests(&adc);
+		sim_adc.run(loop_cycles / 2);
+		rounds += bank.update() ? 1 : 0;
+		sim_adc.run(loop_cycles / 2);
+	}
+	double seconds = sim_adc.cycles_to_seconds(sim_adc.get_cycles());
+	printf("Simulated     : %.3f s, main loop = %u cycles, %.0f conv/s (ADC busy %.1f %%), %.0f rounds/s -> %.0f samples/s\n",
+		   seconds, loop_cycles, sim_adc.get_conversion_nb() / seconds, 100.0 * sim_adc.get_busy_cycles() / sim_adc.get_cycles(),
+		   rounds / seconds, rounds * SENSOR_NB / seconds);
+	return mismatches != 0;
+}
@@ -33,6 +33,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #include <stdint.h>
 #include "adc_tools.h"
 #include "Sensors.h"
+#include "Profiler.h"
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <stddef.h>
@@ -40,8 +41,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 // As we use pure virtual functions in this project, we need to 
 // declare some functions to handle purr virtual functions declarations.
+// (not needed with -DTAGGED_ELEMENT_DISPATCH : the elements have no virtual function anymore)
+#ifndef TAGGED_ELEMENT_DISPATCH
 extern "C" void __cxa_pure_virtual(void);
 void __cxa_pure_virtual(void) {};
+#endif
 
 
 // Global declare an ADC object
@@ -49,42 +53,50 @@ void __cxa_pure_virtual(void) {};
 Adc adc;
 
 // Adc interrupt service routine is declared externally
+// Its body lives in Adc::handle_conversion() so that the host simulation runs the exact same code
 ISR(ADC_vect){
-
-	AnalogSensor* mysensor = adc.get_current_sensor_id();  // retrieves the sensor thanks to its adress stored inside the pending request list
-	if(mysensor != NULL){
-		volatile uint16_t adc_result;
-		adc_result = ADCL;
-		adc_result |= (ADCH<<8);
-		// Pushing left 8 times ADCH (x x x x x x ADC9 ADC8)(8 bits) -> (x x x x x x ADC9 ADC8 x x x x x x x x) (16 bits)
-		// ADCH<<8 | ADCL => (x x x x x x ADC9 ADC8 ADC7 ADC6 ADC5 ADC4 ADC3 ADC2 ADC1 ADC0);
-		// Note : Cannot write (ADCH<<8) | ADCL  => Those registers cannot be accessed all at once!
-		mysensor->set_adc_result(adc_result);  // pushing back the result into the Sensor
-		mysensor->get_adc_handler_ptr()->conversion_complete();  // sends a signal to my sensor class. Handles all internal stuff related to Adc conversion (decrementing total request variable, and so on)
-		adc.conversion_complete();    // Does everything related with the end of conversion (handling counters)
-	}
+	adc.handle_conversion();
 }
 
+// Settings of every sensor, kept in flash and checked at compile time (see SensorConfig.h) :
+// the constructors build the sensors with them, nothing to set up in main()
+// mux, in_min, in_max, out_min, out_max, dz_min, dz_max, dz_neutral, bypass mask, priority, oversampling
+constexpr GimbalConfig left_config PROGMEM = {
+	{ADC0D, 0, 1023, -100, 100, 480, 550, (480 + 550)/2, AXIS_DEFAULT_BYPASS, 0, 0},	// ADC0 and ADC1 (PORTC0 and PORTC1 on Atmega328P)
+	{ADC1D, 0, 1023, -100, 100, 460, 620, (460 + 620)/2, AXIS_DEFAULT_BYPASS, 0, 0},
+	0, 0	// Separate requests, square deadzones
+};
+constexpr GimbalConfig right_config PROGMEM = {
+	{ADC2D, 0, 1023, -100, 100, 510, 514, 512, AXIS_DEFAULT_BYPASS, 0, 0},
+	{ADC3D, 0, 1023, -100, 100, 512, 512, 512, AXIS_DEFAULT_BYPASS | SENSOR_BYPASS(DZone), 0, 0},
+	0, 0
+};
+constexpr SensorConfig pot_configs[3] PROGMEM = {
+	// Still on ADC0, as the default constructed pots : set their channels to the board wiring (see Readme.md)
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+	{ADC0D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0},
+};
+static_assert(is_valid_config(left_config) && is_valid_config(right_config), "Invalid gimbal settings");
+static_assert(is_valid_config(pot_configs[0]) && is_valid_config(pot_configs[1]) && is_valid_config(pot_configs[2]),
+			  "Invalid potentiometer settings");
+static_assert(left_config.x.mux != right_config.x.mux && left_config.y.mux != right_config.y.mux &&
+			  left_config.x.mux != right_config.y.mux && left_config.y.mux != right_config.x.mux, "Gimbals share an adc channel");
+
 // Global declaration only to allow user to track data anywhere when debugging (global scoping)
 // In real-life program execution, those declarations should be used inside main function right underneath
-Potentiometer pot1,pot2,pot3;
-Gimbal left_g,right_g;
+Potentiometer pot1(&pot_configs[0]),pot2(&pot_configs[1]),pot3(&pot_configs[2]);
+Gimbal left_g(&left_config),right_g(&right_config);
 
 int main(void)
 {
-	// First set deadzones (if any) : (dz_min, dz_max, dz_neutral, bypass_state)
-	left_g.get_x_axis_ptr()->set_deadzone(480,550,(480 + 550)/2,0);
-	left_g.get_y_axis_ptr()->set_deadzone(460,620,(460 + 620)/2,0);
-	// Setting adc muxes to ADC0 and ADC1 (PORTC0 and PORTC1 on Atmega328P)
-	left_g.set_adc_muxes(ADC0D,ADC1D);
-	// Same for right gimbal
-	right_g.get_x_axis_ptr()->set_deadzone(510,514,512,0);
-	right_g.get_y_axis_ptr()->set_bypass(TransformElement::DZone,1);
-	right_g.set_adc_muxes(ADC2D,ADC3D);
-	
 	// Initialize the adc object (sets adc prescaler, reference voltage, etc)
 	// Have a look inside adc_tools.h/cpp for further details
 	adc.initialize();
+#ifdef CYCLE_PROFILER
+	// Timer1 free running : probes count cpu cycles, profiler.dump() writes their table (e.g. to a UART)
+	profiler.initialize();
+#endif
 	// enable interruptions
 	sei();
 	
@@ -0,0 +1,115 @@
+#include "Profiler.h"
+
+#ifdef CYCLE_PROFILER
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+CycleProfiler profiler;
+
+#define PROFILE_NAME_SIZE 20
+static const char site_names[CycleProfiler::SiteNb][PROFILE_NAME_SIZE] PROGMEM = {
+	"DataHandler", "Filter", "Deadzone", "Modifier", "TrimHandler", "MedianFilter", "NoiseStats", "External element",
+	"Fused run", "transform()", "start_conversion()", "ADC ISR"
+};
+
+void CycleProfiler::initialize()
+{
+#ifdef __AVR__
+	TCCR1A = 0;
+	TCCR1B = 1 << CS10;	// Normal mode, no prescaler : counts cpu cycles
+#endif
+	// Cost of an empty probe : smallest of a few tries (an interrupt may fall in between)
+	overhead = 0;
+	for (uint8_t i = 0; i < 8; i++) {
+		profile_time_t start = PROFILE_NOW();
+		profile_time_t elapsed = PROFILE_NOW() - start;
+		if (i == 0 || elapsed < overhead) overhead = elapsed;
+	}
+	reset();
+}
+
+void CycleProfiler::reset()
+{
+	uint8_t sreg = SREG;
+	cli();
+	for (uint8_t i = 0; i < SiteNb; i++) {
+		stats[i].count = 0;
+		stats[i].min = 0;
+		stats[i].max = 0;
+		stats[i].sum = 0;
+	}
+	SREG = sreg;
+}
+
+void CycleProfiler::record(uint8_t site, profile_time_t elapsed)
+{
+	if (site >= SiteNb) return;
+	elapsed = elapsed > overhead ? elapsed - overhead : 0;
+	uint8_t sreg = SREG;	// start_conversion() runs in the main loop and in the ISR
+	cli();
+	ProfileStats* entry = &stats[site];
+	if (entry->count == 0 || elapsed < entry->min) entry->min = elapsed;
+	if (elapsed > entry->max) entry->max = elapsed;
+	entry->sum += elapsed;
+	entry->count++;
+	SREG = sreg;
+}
+
+uint8_t CycleProfiler::get_stats(uint8_t site, ProfileStats* n_stats)
+{
+	if (site >= SiteNb) return 0;
+	uint8_t sreg = SREG;
+	cli();
+	*n_stats = stats[site];
+	SREG = sreg;
+	return n_stats->count != 0;
+}
+
+profile_time_t CycleProfiler::get_mean(uint8_t site)
+{
+	ProfileStats copy;
+	if (!get_stats(site, &copy)) return 0;
+	return (profile_time_t)((copy.sum + copy.count / 2) / copy.count);
+}
+
+profile_time_t CycleProfiler::get_overhead() {return overhead;}
+
+// No printf : the numbers are written digit by digit
+static void put_number(void (*put_char)(char), profile_sum_t value)
+{
+	char digits[20];
+	uint8_t nb = 0;
+	do {
+		digits[nb++] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	while (nb > 0) put_char(digits[--nb]);
+}
+
+static void put_text(void (*put_char)(char), const char* text)
+{
+	while (*text) put_char(*text++);
+}
+
+void CycleProfiler::dump(void (*put_char)(char))
+{
+	for (uint8_t i = 0; i < SiteNb; i++) {
+		ProfileStats copy;
+		if (!get_stats(i, &copy)) continue;
+		char c;
+		for (uint8_t j = 0; j < PROFILE_NAME_SIZE && (c = pgm_read_byte(&site_names[i][j])) != 0; j++) put_char(c);
+		put_text(put_char, " n ");
+		put_number(put_char, copy.count);
+		put_text(put_char, " min ");
+		put_number(put_char, copy.min);
+		put_text(put_char, " max ");
+		put_number(put_char, copy.max);
+		put_text(put_char, " mean ");
+		put_number(put_char, get_mean(i));
+		put_text(put_char, "\r\n");
+	}
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+Version |   date   |  description
+V 0.1   17/10/2026  Hot path probes (pipelines, elements, Adc) : count, min, max and mean duration per site
+*/
+
+#ifndef CYCLE_PROFILER_HEADER
+#define CYCLE_PROFILER_HEADER
+
+// Build with -DCYCLE_PROFILER to time the hot path. Probes are placed around :
+//  -> TransformPipeline / StaticPipeline / SharedPipeline transform() and each element compute() (one site per element type,
+//     a fused run of affine stages is one more site)
+//  -> Adc::start_conversion() and Adc::handle_conversion() (ADC_vect body : prologue and epilogue of the ISR are not counted)
+// Without it the probes expand to nothing and none of this is compiled.
+// On the AVR, durations are Timer1 counts : initialize() sets it free running at the cpu clock (prescaler 1), so they are
+// cpu cycles (spans up to 65535 cycles). Timer1 may still be used as a free running time base (e.g. -DADC_TIMESTAMP=TCNT1).
+// On the host they are sim_host_ticks() (monotonic host counter).
+// The cost of a probe (two counter reads) is measured by initialize() and subtracted. Nested sites (transform() and its
+// elements, the ISR and start_conversion()) include the probes of the inner ones.
+#ifdef CYCLE_PROFILER
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#ifdef __AVR__
+typedef uint16_t profile_time_t;
+typedef uint32_t profile_sum_t;
+#define PROFILE_NOW() TCNT1
+#else
+typedef uint32_t profile_time_t;
+typedef uint64_t profile_sum_t;
+#define PROFILE_NOW() ((profile_time_t) sim_host_ticks())
+#endif
+
+struct ProfileStats
+{
+	uint32_t count;
+	profile_time_t min;
+	profile_time_t max;
+	profile_sum_t sum;
+};
+
+class CycleProfiler
+{
+	public:
+		// Element sites are FirstElement + TransformElement::T_Elmt_Key (DHandler, DFilter, DZone...)
+		enum Site {FirstElement = 0, FusedRun = 8, Transform, AdcStart, AdcIsr, SiteNb};
+		void initialize();	// Starts the time base, measures the probe overhead and clears the table
+		void reset();
+		void record(uint8_t site, profile_time_t elapsed);	// Called by the probes (main loop and ISR)
+		uint8_t get_stats(uint8_t site, ProfileStats* stats);	// Consistent copy, returns 0 if the site has no sample
+		profile_time_t get_mean(uint8_t site);
+		profile_time_t get_overhead();
+		// Writes one text line per site which has samples ("name n count min x max y mean z"), e.g. to a UART
+		void dump(void (*put_char)(char));
+	private:
+		ProfileStats stats[SiteNb];
+		profile_time_t overhead;
+};
+
+extern CycleProfiler profiler;
+
+// Times the enclosing scope (all its returns)
+class ProfileProbe
+{
+	public:
+		ProfileProbe(uint8_t n_site) : site(n_site), start(PROFILE_NOW()) {}
+		~ProfileProbe() {profiler.record(site, PROFILE_NOW() - start);}
+	private:
+		uint8_t site;
+		profile_time_t start;
+};
+
+#define PROFILE_SCOPE(site) ProfileProbe profile_probe(site)
+#define PROFILE_BEGIN(start) profile_time_t start = PROFILE_NOW()
+#define PROFILE_END(site, start) profiler.record(site, PROFILE_NOW() - start)
+
+#else
+
+#define PROFILE_SCOPE(site)
+#define PROFILE_BEGIN(start)
+#define PROFILE_END(site, start)
+
+#endif
+
+#endif
@@ -1,5 +1,7 @@
 ﻿
 #include "S_PipeElement.h"
+#include <avr/pgmspace.h>
+#include <stddef.h>
 
 const int16_t d_min_lin_space = 0;	// Default minimum value for LinearSpaces
 const int16_t d_max_lin_space = 1023;	// Default maximum value for LinearSpaces
@@ -14,8 +16,6 @@ const int16_t d_out_max = 100; // Default output space maximum
 
 LinearSpace::LinearSpace() : min(d_min_lin_space) , max(d_max_lin_space) {}
 LinearSpace::LinearSpace(int16_t n_min, int16_t n_max): min(n_min),max(n_max){}
-const int16_t LinearSpace::get_max(){return max;}
-const int16_t LinearSpace::get_min(){return min;}
 const int16_t LinearSpace::get_delta(){return (max - min);}
 void LinearSpace::set_min(int16_t n_min) {min = n_min;}
 void LinearSpace::set_max(int16_t n_max) {max = n_max;}
@@ -26,13 +26,72 @@ void LinearSpace::set_max(int16_t n_max) {max = n_max;}
 /************************************************************************/
 
 // QUESTION: Reflexion about input & output spaces (aren't int16 a bit of overkill?)
-DataHandler::DataHandler() : TransformElement(DHandler),input_space(),output_space(d_out_min, d_out_max), reverse_mode(0) {}
+DataHandler::DataHandler() : TransformElement(DHandler),input_space(),output_space(d_out_min, d_out_max), reverse_mode(0),
+table_mode(NoTable), table(NULL) {update_coefficients();}
 DataHandler::DataHandler(int16_t in_min,int16_t in_max, int16_t out_min ,int16_t out_max ,uint8_t reverse) :
-TransformElement(DHandler),input_space(in_min,in_max),output_space(out_min,out_max), reverse_mode(reverse){}
+TransformElement(DHandler),input_space(in_min,in_max),output_space(out_min,out_max), reverse_mode(reverse),
+table_mode(NoTable), table(NULL) {update_coefficients();}
 
-// Analog sensor values related methods :
+// Analog sensor values related methods (compute() is inline, see S_PipeElement.h) :
 
-int16_t DataHandler::compute(int16_t input)
+// Precomputes the fixed-point reciprocal used by compute()
+// trunc(x * out_delta / in_delta) == sign * ((|x| * scale) >> shift) as long as 2^shift >= max|x| * |in_delta|
+// with scale = ceil(|out_delta| * 2^shift / |in_delta|) (rounding error of scale never reaches the next integer)
+void DataHandler::update_coefficients()
+{
+	int32_t in_delta = input_space.get_delta();		// Same 16 bits deltas as compute_exact()
+	int32_t out_delta = output_space.get_delta();
+	fast_mode = 0;
+	// Domain : [0 ; DH_TABLE_SIZE - 1] and the input space, whose top is rounded up to 2^n - 1 (samples of an n bits converter)
+	int16_t in_low = input_space.get_min() < input_space.get_max() ? input_space.get_min() : input_space.get_max();
+	int16_t in_high = input_space.get_min() < input_space.get_max() ? input_space.get_max() : input_space.get_min();
+	fast_min = in_low < 0 ? in_low : 0;
+	fast_max = DH_TABLE_SIZE - 1;
+	while(fast_max < in_high && fast_max < 0x3FFF) fast_max = (fast_max << 1) | 1;
+	if(fast_max < in_high) fast_max = in_high;
+	origin = reverse_mode ? input_space.get_max() : input_space.get_min();
+	// reversed input : in_max + in_min - input - in_min = -(input - in_max)
+	negate = ((in_delta < 0) != (out_delta < 0)) != (reverse_mode != 0);
+	if(in_delta == 0) return;
+	// Reverse mode computes in_max + in_min - input on 16 bits : keep the division when it overflows
+	int32_t reversed_sum = (int32_t) input_space.get_max() + input_space.get_min();
+	if(reverse_mode && (reversed_sum - fast_min > 32767 || reversed_sum - fast_max < -32768)) return;
+	uint32_t id = in_delta < 0 ? -in_delta : in_delta;
+	uint32_t od = out_delta < 0 ? -out_delta : out_delta;
+	// Biggest |input - origin| for inputs in [fast_min ; fast_max]
+	int32_t low = (int32_t) origin - fast_min;
+	int32_t high = (int32_t) fast_max - origin;
+	uint32_t x_max = low < 0 ? -low : low;
+	if(high < 0) high = -high;
+	if((uint32_t) high > x_max) x_max = high;
+	if(x_max > 0x7FFF || x_max > 0xFFFFFFFFUL / id) return;	// input - origin must fit in 16 bits
+
+	uint8_t n_shift = 0;
+	while(n_shift < 31 && ((uint32_t) 1 << n_shift) < x_max * id) n_shift++;
+	if(((uint32_t) 1 << n_shift) < x_max * id) return;
+	// scale = (od / id) << shift + ceil((od % id) << shift / id), computed bit by bit to stay within 32 bits
+	uint32_t quotient = od / id;
+	uint32_t remainder = od % id;
+	uint32_t fraction = 0;
+	if(quotient != 0 && quotient > (0xFFFFFFFFUL >> n_shift)) return;
+	for(uint8_t i = 0; i < n_shift; i++) {
+		remainder <<= 1;
+		fraction <<= 1;
+		if(remainder >= id) {
+			remainder -= id;
+			fraction |= 1;
+		}
+	}
+	if(remainder != 0) fraction++;
+	uint32_t n_scale = (quotient << n_shift) + fraction;
+	if(n_scale < fraction) return;	// overflow
+	if(x_max != 0 && n_scale > 0xFFFFFFFFUL / x_max) return;	// |x| * scale must fit in 32 bits
+	scale = n_scale;
+	shift = n_shift;
+	fast_mode = 1;
+}
+
+int16_t DataHandler::compute_exact(int16_t input)
 {
 	// Note : to perform this calculation correctly, it is necessary that
 	// operations are done in the right order.
@@ -53,20 +112,27 @@ int16_t DataHandler::compute(int16_t input)
 
 // Linear Spaces initializers
 void DataHandler::set_ranges(int16_t in_min,int16_t in_max, int16_t out_min, int16_t out_max){
+	uint8_t changed = 0;
 	if(input_space.get_min() != in_min ) {
 		input_space.set_min(in_min);
-	changed_flag = 1;}				// Used to know if
+	changed = 1;}				// Used to know if
 	if(input_space.get_max() != in_max ){
 		input_space.set_max(in_max);
-		changed_flag = 1;
+		changed = 1;
 	}
 	if(output_space.get_min() != out_min ) {
 		output_space.set_min(out_min);
-		changed_flag = 1;
+		changed = 1;
 	}
 	if(output_space.get_max() != out_max) {
 		output_space.set_max(out_max);
-		changed_flag = 1;
+		changed = 1;
+	}
+	if(changed) {
+		update_coefficients();
+		if(table_mode == RamTable) fill_table(const_cast<int16_t*>(table));
+		if(table_mode == FlashTable) disable_table();	// Flash table was generated for the old ranges
+		notify_change();
 	}
 }
 
@@ -76,7 +142,183 @@ LinearSpace* DataHandler::get_input_space_ptr() {return &input_space;}
 LinearSpace* DataHandler::get_output_space_ptr() {return &output_space;}
 
 const uint8_t DataHandler::is_reversed() {return reverse_mode;}
-void DataHandler::reverse(uint8_t state) {reverse_mode = state;}
+void DataHandler::reverse(uint8_t state) {
+	if(state == reverse_mode) return;
+	reverse_mode = state;
+	notify_change();
+	update_coefficients();
+	if(table_mode == RamTable) fill_table(const_cast<int16_t*>(table));
+	if(table_mode == FlashTable) disable_table();
+}
+
+void DataHandler::fill_table(int16_t* n_table) {
+	for(int16_t i = 0; i < DH_TABLE_SIZE; i++) n_table[i] = compute_exact(i);
+}
+void DataHandler::use_ram_table(int16_t* n_table) {
+	if(n_table == NULL) return;
+	fill_table(n_table);
+	table = n_table;
+	table_mode = RamTable;
+}
+void DataHandler::use_flash_table(const int16_t* n_table) {
+	if(n_table == NULL) return;
+	table = n_table;
+	table_mode = FlashTable;
+	notify_change();	// Table may differ from the computed mapping
+}
+void DataHandler::disable_table() {
+	table = NULL;
+	table_mode = NoTable;
+}
+uint8_t DataHandler::get_table_mode() {return table_mode;}
+uint8_t DataHandler::get_coefficients(int16_t* n_origin, uint32_t* n_scale, uint8_t* n_shift, uint8_t* n_negate) {
+	if(!fast_mode) return 0;
+	*n_origin = origin;
+	*n_scale = scale;
+	*n_shift = shift;
+	*n_negate = negate;
+	return 1;
+}
+// Flash tables may differ from the computed mapping, RAM tables are filled with it
+uint8_t DataHandler::get_affine(AffineMap* map) {
+	if(table_mode == FlashTable || !get_coefficients(&map->origin, &map->scale, &map->shift, &map->negate)) return 0;
+	map->offset = output_space.get_min();
+	map->in_min = fast_min;
+	map->in_max = fast_max;
+	return 1;
+}
+
+
+/************************************************************************/
+/* TrimHandler implementation                                           */
+/************************************************************************/
+
+const int16_t trim_default_limit = 25;	// +/- 25 % of the default output space
+const uint8_t trim_default_step = 1;
+
+TrimHandler::TrimHandler() : TransformElement(TrimH), offset(0), limits(-trim_default_limit, trim_default_limit),
+inc_mode(Constant), inc_step(trim_default_step), repeat(0), last_direction(0) {}
+TrimHandler::TrimHandler(uint8_t mode, uint8_t n_step, int16_t min_offset, int16_t max_offset, uint8_t initial_bypass) :
+TransformElement(initial_bypass, TrimH), offset(0), limits(min_offset, max_offset), inc_mode(mode), inc_step(n_step),
+repeat(0), last_direction(0) {}
+
+uint8_t TrimHandler::get_affine(AffineMap* map)
+{
+	map->set_identity();
+	map->offset = offset;
+	if(offset > 0) map->in_max = 32767 - offset;
+	else map->in_min = -32768 - offset;
+	return 1;
+}
+
+void TrimHandler::step(int8_t direction)
+{
+	if(direction != last_direction) repeat = 0;
+	last_direction = direction;
+	int32_t increment = inc_step;
+	if(inc_mode == Linear) increment *= (int32_t) repeat + 1;
+	if(inc_mode == Exponential) increment <<= (repeat < 7 ? repeat : 7);
+	if(repeat < 0xFF) repeat++;
+	int32_t target = (int32_t) offset + direction * increment;
+	if(target > limits.get_max()) target = limits.get_max();
+	if(target < limits.get_min()) target = limits.get_min();
+	set_offset((int16_t) target);
+}
+
+void TrimHandler::step_up() {step(1);}
+void TrimHandler::step_down() {step(-1);}
+void TrimHandler::release()
+{
+	repeat = 0;
+	last_direction = 0;
+}
+
+void TrimHandler::set_offset(int16_t n_offset)
+{
+	if(n_offset > limits.get_max()) n_offset = limits.get_max();
+	if(n_offset < limits.get_min()) n_offset = limits.get_min();
+	if(n_offset == offset) return;
+	offset = n_offset;
+	notify_change();
+}
+int16_t TrimHandler::get_offset() {return offset;}
+void TrimHandler::set_limits(int16_t min_offset, int16_t max_offset)
+{
+	limits.set_min(min_offset);
+	limits.set_max(max_offset);
+	set_offset(offset);
+}
+void TrimHandler::set_inc_mode(uint8_t mode) {inc_mode = mode; release();}
+uint8_t TrimHandler::get_inc_mode() {return inc_mode;}
+void TrimHandler::set_inc_step(uint8_t n_step) {inc_step = n_step;}
+uint8_t TrimHandler::get_inc_step() {return inc_step;}
+
+
+/************************************************************************/
+/* Modifier implementation                                              */
+/************************************************************************/
+
+const uint8_t modifier_default_expo = 0;
+const uint8_t modifier_default_rate = 100;
+
+Modifier::Modifier() : TransformElement(Mod), range(d_out_min, d_out_max), expo(modifier_default_expo), rate(modifier_default_rate) {
+	build_table();
+}
+Modifier::Modifier(int16_t min, int16_t max, uint8_t n_expo, uint8_t n_rate, uint8_t initial_bypass) : TransformElement(initial_bypass, Mod),
+range(min, max), expo(n_expo > 100 ? 100 : n_expo), rate(n_rate > 100 ? 100 : n_rate) {
+	build_table();
+}
+
+// Points are computed in Q12 (4096 = 1) : x^3 fits in 32 bits when computed in two steps
+void Modifier::build_table()
+{
+	int32_t delta = (int32_t) range.get_max() - range.get_min();
+	step_scale = delta > 0 ? (((uint32_t) 1 << 28) + delta / 2) / delta : 0;
+	int32_t center = ((int32_t) range.get_max() + range.get_min()) / 2;
+	int32_t half = delta / 2;
+	for(uint8_t k = 0; k < MOD_TABLE_SIZE; k++)
+	{
+		int32_t x = ((int32_t) k - MOD_SEGMENTS / 2) * (4096 / (MOD_SEGMENTS / 2));
+		int32_t x3 = x * x / 4096 * x / 4096;
+		int32_t y = ((100 - expo) * x + expo * x3) / 100;
+		y = y * rate / 100;
+		table[k] = (int16_t)(center + y * half / 4096);
+	}
+}
+
+void Modifier::set_ranges(int16_t min, int16_t max)
+{
+	if(min == range.get_min() && max == range.get_max()) return;
+	range.set_min(min);
+	range.set_max(max);
+	notify_change();
+	build_table();
+}
+void Modifier::set_expo(uint8_t n_expo)
+{
+	if(n_expo > 100) n_expo = 100;
+	if(n_expo == expo) return;
+	expo = n_expo;
+	notify_change();
+	build_table();
+}
+void Modifier::set_rate(uint8_t n_rate)
+{
+	if(n_rate > 100) n_rate = 100;
+	if(n_rate == rate) return;
+	rate = n_rate;
+	notify_change();
+	build_table();
+}
+void Modifier::set_curve(const int16_t* points)
+{
+	if(points == NULL) return;
+	for(uint8_t k = 0; k < MOD_TABLE_SIZE; k++) table[k] = points[k];
+	notify_change();
+}
+uint8_t Modifier::get_expo() {return expo;}
+uint8_t Modifier::get_rate() {return rate;}
+const int16_t* Modifier::get_table() {return table;}
 
 
 const int16_t deadzone_default_min = 512;
@@ -93,45 +335,227 @@ void Deadzone::set_ranges(uint16_t min,uint16_t max)
 {
 	boundaries.set_max(max);
 	boundaries.set_min(min);
+	notify_change();
 }
 
-void Deadzone::set_neutral(uint16_t neutral_value) {neutral = neutral_value;}
+void Deadzone::set_neutral(uint16_t neutral_value) {
+	neutral = neutral_value;
+	notify_change();
+}
 uint16_t Deadzone::get_deadzone_max() {return boundaries.get_max();}
 uint16_t Deadzone::get_deadzone_min(){return boundaries.get_min();}
 uint16_t Deadzone::get_deadzone_neutral(){return neutral;}
 
-int16_t Deadzone::compute(int16_t input){
-	int16_t output = 0;
-	if(input < boundaries.get_max() && input > boundaries.get_min()) {
-		output = neutral;
-	}
-	else output = input;
-	return output;
-}
 LinearSpace* Deadzone::get_deadzone_boundaries_ptr() {return &boundaries;}
 
 
 
 /************************************************************************/
-/* DataFilter implementation                                            */
+/* IirFilter implementation                                             */
+/* (DataFilter, MovingAverage and EmaFilter are templates : see header)  */
 /************************************************************************/
 
-DataFilter::DataFilter():TransformElement(DFilter),sum(0),processing_iterator(0){
+IirFilter::IirFilter():ExternalElement(0, DFilter),b0(1 << (IIR_Q - 3)),b1(1 << (IIR_Q - 3)),a1(3 << (IIR_Q - 2)){
+	attach_compute<IirFilter>(this);
 	init_filter(0);
 }
-DataFilter::DataFilter(uint8_t init_bypass, int16_t initial_filter_v ):TransformElement(init_bypass,DFilter),sum(DATA_FILTER_SIZE * initial_filter_v ){
+IirFilter::IirFilter(uint8_t init_bypass, int16_t initial_filter_v ):ExternalElement(init_bypass, DFilter),
+b0(1 << (IIR_Q - 3)),b1(1 << (IIR_Q - 3)),a1(3 << (IIR_Q - 2)){
+	attach_compute<IirFilter>(this);
 	init_filter(initial_filter_v);
 }
-int16_t DataFilter::compute(int16_t input){
-	sum = sum + input - sliding_array[processing_iterator];
-	sliding_array[processing_iterator] = input;
-	output = sum / DATA_FILTER_SIZE;
-	processing_iterator = (processing_iterator + 1) % DATA_FILTER_SIZE;
+int16_t IirFilter::compute(int16_t input){
+	int32_t acc = (int32_t) b0 * input + (int32_t) b1 * last_input + (int32_t) a1 * output;
+	last_input = input;
+	output = (int16_t)((acc + ((int32_t) 1 << (IIR_Q - 1))) >> IIR_Q);
 	return output;
 }
+void IirFilter::set_coefficients(int16_t n_b0, int16_t n_b1, int16_t n_a1){
+	b0 = n_b0;
+	b1 = n_b1;
+	a1 = n_a1;
+	notify_change();
+}
+void IirFilter::init_filter(int16_t init_value){
+	last_input = init_value;
+	output = init_value;
+}
+int16_t IirFilter::get_output(){return output;}
+// h[0] = b0, h[1] = b1 + a1 * b0, h[k] = a1^(k-1) * h[1] : sum of h^2 = b0^2 + h[1]^2 / (1 - a1^2)
+uint16_t IirFilter::get_noise_gain(){
+	const uint32_t one = (uint32_t) 1 << (2 * IIR_Q);
+	uint32_t pole = (uint32_t)((int32_t) a1 * a1);
+	if(pole >= one) return 0xFFFF;
+	int32_t h1 = b1 + (((int32_t) a1 * b0) >> IIR_Q);
+	uint64_t energy = (uint64_t)((int32_t) b0 * b0) + (((uint64_t)((int64_t) h1 * h1) << (2 * IIR_Q)) / (one - pole));
+	energy >>= 2 * IIR_Q - 8;	// Q8
+	return energy > 0xFFFF ? 0xFFFF : (uint16_t) energy;
+}
+
+
+/************************************************************************/
+/* NoiseStats implementation                                            */
+/************************************************************************/
+
+// Integer square root (bit by bit, no division)
+static uint16_t square_root(uint32_t value){
+	uint32_t root = 0;
+	uint32_t bit = (uint32_t) 1 << 30;
+	while(bit > value) bit >>= 2;
+	while(bit != 0) {
+		if(value >= root + bit) {
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else root >>= 1;
+		bit >>= 2;
+	}
+	return (uint16_t) root;
+}
+
+NoiseStats::NoiseStats():TransformElement(1, DStats){restart();}
+void NoiseStats::restart(){
+	reference = 0;
+	sum = 0;
+	square_sum = 0;
+	count = 0;
+	min = 0;
+	max = 0;
+}
+uint16_t NoiseStats::get_count(){return count;}
+uint8_t NoiseStats::is_complete(){return count >= NOISE_STATS_SAMPLES;}
+int16_t NoiseStats::get_mean(){
+	if(count == 0) return 0;
+	int32_t offset = sum >= 0 ? (sum + count / 2) / count : -((-sum + count / 2) / count);
+	return (int16_t)(reference + offset);
+}
+int16_t NoiseStats::get_min(){return min;}
+int16_t NoiseStats::get_max(){return max;}
+// (n * sum(d^2) - sum(d)^2) / n^2, exact until the final division
+uint64_t NoiseStats::get_spread(){return (uint64_t) square_sum * count - (uint64_t)((int64_t) sum * sum);}
+uint32_t NoiseStats::get_variance(uint8_t averaged_samples){
+	if(count < 2 || averaged_samples == 0) return 0;
+	return (uint32_t)((get_spread() << 8) / ((uint64_t) count * count * averaged_samples));
+}
+uint16_t NoiseStats::get_std_dev(uint8_t averaged_samples){return square_root(get_variance(averaged_samples));}
+uint32_t NoiseStats::get_filtered_variance(uint16_t noise_gain){
+	if(count < 2) return 0;
+	return (uint32_t)(get_spread() * noise_gain / ((uint64_t) count * count));
+}
+uint16_t NoiseStats::get_filtered_std_dev(uint16_t noise_gain){return square_root(get_filtered_variance(noise_gain));}
+uint8_t NoiseStats::suggest_filter_size(){
+	uint32_t variance = get_variance();
+	uint8_t size = 1;
+	while(size < 64 && variance / size > 64) size <<= 1;	// 64 = (1/2 LSB)^2 in Q8
+	return size;
+}
+
+
+
+/************************************************************************/
+/* RadialDeadzone implementation                                        */
+/************************************************************************/
+
+// sqrt(1 + (i / RADIAL_TABLE_SEGMENTS)^2) in Q14
+static const uint16_t radial_table[RADIAL_TABLE_SEGMENTS + 1] PROGMEM = {
+	16384, 16392, 16416, 16456, 16512, 16583, 16670, 16771, 16888, 17020, 17165, 17325, 17498, 17684, 17883, 18095, 18318,
+	18552, 18798, 19054, 19321, 19597, 19882, 20177, 20480, 20791, 21110, 21437, 21771, 22111, 22458, 22811, 23170
+};
+
+RadialDeadzone::RadialDeadzone() : center(0), range(100), radius(0), gain(1 << 14) {}
+
+uint8_t RadialDeadzone::set_ranges(int16_t n_center, int16_t n_range, int16_t n_radius)
+{
+	if(n_range <= 0 || n_radius < 0 || n_radius > n_range / 2) return 0;	// gain stays under 2 (Q14 products fit in 32 bits)
+	center = n_center;
+	range = n_range;
+	radius = n_radius;
+	gain = (uint16_t)(((uint32_t) n_range << 14) / (n_range - n_radius));
+	return 1;
+}
+
+void RadialDeadzone::compute(int16_t* x, int16_t* y)
+{
+	int32_t dx = (int32_t) *x - center;
+	int32_t dy = (int32_t) *y - center;
+	if(dx < -0x7FFF) dx = -0x7FFF;
+	if(dx > 0x7FFF) dx = 0x7FFF;
+	if(dy < -0x7FFF) dy = -0x7FFF;
+	if(dy > 0x7FFF) dy = 0x7FFF;
+	uint16_t abs_x = dx < 0 ? -dx : dx;
+	uint16_t abs_y = dy < 0 ? -dy : dy;
+	uint16_t high = abs_x > abs_y ? abs_x : abs_y;
+	uint16_t low = abs_x > abs_y ? abs_y : abs_x;
+	if(high <= radius) {	// r >= m : m inside the circle is necessary, not sufficient
+		// Outside of this test, m > radius / sqrt(2) : radius / m (Q24) fits in 32 bits below
+		if((uint32_t) abs_x * abs_x + (uint32_t) abs_y * abs_y <= (uint32_t) radius * radius) {
+			*x = center;
+			*y = center;
+			return;
+		}
+	}
+	uint32_t inverse = ((uint32_t) 1 << 24) / high;	// 1 / m, Q24 (the only division)
+	uint32_t ratio = ((uint32_t) low * inverse) >> 8;	// t = low / m, Q16
+	uint8_t index = ratio >> 11;	// 65536 / RADIAL_TABLE_SEGMENTS
+	uint16_t fraction = ratio & 2047;
+	int32_t norm = pgm_read_word(&radial_table[index]);	// sqrt(1 + t^2), Q14
+	if(index < RADIAL_TABLE_SEGMENTS)
+		norm += ((int32_t)(pgm_read_word(&radial_table[index + 1]) - norm) * fraction) >> 11;
+	// (r - radius) / m = sqrt(1 + t^2) - radius / m
+	int32_t scale = norm - (int32_t)(((uint32_t) radius * inverse) >> 10);
+	if(scale <= 0) {
+		*x = center;
+		*y = center;
+		return;
+	}
+	scale = (scale * gain) >> 14;	// Q14
+	int32_t n_x = (dx * scale + (1 << 13)) >> 14;
+	int32_t n_y = (dy * scale + (1 << 13)) >> 14;
+	if(n_x > range) n_x = range;
+	if(n_x < -range) n_x = -range;
+	if(n_y > range) n_y = range;
+	if(n_y < -range) n_y = -range;
+	*x = (int16_t)(center + n_x);
+	*y = (int16_t)(center + n_y);
+}
+int16_t RadialDeadzone::get_center() {return center;}
+int16_t RadialDeadzone::get_range() {return range;}
+int16_t RadialDeadzone::get_radius() {return radius;}
+
+
+#ifdef TAGGED_ELEMENT_DISPATCH
+/************************************************************************/
+/* Tagged dispatch of the TransformElement (-DTAGGED_ELEMENT_DISPATCH)  */
+/* Every element class is known here : the switch calls them directly  */
+/************************************************************************/
+
+// compute() is inline (S_PipeElement.h)
+
+uint8_t TransformElement::is_stateful()
+{
+	switch(type) {
+		case DFilter : return DataFilter::stateful;
+		case DStats : return NoiseStats::stateful;
+		case DExternal : return 1;	// Filters
+		default : return 0;
+	}
+}
 
-void DataFilter::init_filter(int16_t init_value){
-	for(uint8_t i=0;i<DATA_FILTER_SIZE;i++) sliding_array[i] = init_value;
+uint8_t TransformElement::get_affine(AffineMap* map)
+{
+	switch(type) {
+		case DHandler : return static_cast<DataHandler*>(this)->get_affine(map);
+		case TrimH : return static_cast<TrimHandler*>(this)->get_affine(map);
+		default : return 0;
+	}
 }
 
-int16_t DataFilter::get_output(){return output;}
+uint16_t TransformElement::get_noise_gain()
+{
+	switch(type) {
+		case DFilter : return static_cast<DataFilter*>(this)->get_noise_gain();
+		case DExternal : return static_cast<ExternalElement*>(this)->noise_gain_fn(this);
+		default : return 256;
+	}
+}
+#endif
\ No newline at end of file
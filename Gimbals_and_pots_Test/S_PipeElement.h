@@ -2,6 +2,7 @@
 #define SENSOR_PIPE_ELEM
 
 #include <stdint.h>
+#include <avr/pgmspace.h>
 #include "TransformPipeline.h"
 
 // Class linear space which holds informations and functions about a 16-bit numerical range (boundaries only)
@@ -12,8 +13,8 @@ class LinearSpace{
 	// Regular setters and getters
 	void set_max(int16_t n_max);
 	void set_min(int16_t n_min);
-	const int16_t get_max();
-	const int16_t get_min();
+	const int16_t get_max() {return max;}	// Inline : read by compute() of every sample
+	const int16_t get_min() {return min;}
 	const int16_t get_delta();
 
 	private:
@@ -49,8 +50,81 @@ class Deadzone : public TransformElement
 
 
 
+// TrimHandler class : adds a trim offset to the mapped value (Axis output space).
+// The offset is moved by trim steps (e.g. two momentary switches) whose size depends on the increment mode :
+//  -> Constant : inc_step per step
+//  -> Linear : inc_step, 2 x inc_step, 3 x inc_step... while steps keep the same direction
+//  -> Exponential : inc_step, 2 x, 4 x, 8 x... while steps keep the same direction
+// release() (switch released) or a step in the other direction restarts from inc_step.
+// Trimming only changes the offset : the DataHandler ranges and coefficients are left untouched.
+class TrimHandler : public TransformElement
+{
+	public:
+	enum Trim_Mode {Constant, Linear, Exponential};
+	TrimHandler();
+	TrimHandler(uint8_t mode, uint8_t step, int16_t min_offset, int16_t max_offset, uint8_t initial_bypass);
+	int16_t compute(int16_t input);
+	uint8_t get_affine(AffineMap* map);	// Translation, over the inputs which don't saturate
+	void step_up();
+	void step_down();
+	void release();
+	void set_offset(int16_t n_offset);	// Clamped to the limits
+	int16_t get_offset();
+	void set_limits(int16_t min_offset, int16_t max_offset);
+	void set_inc_mode(uint8_t mode);
+	uint8_t get_inc_mode();
+	void set_inc_step(uint8_t step);
+	uint8_t get_inc_step();
+	private:
+	void step(int8_t direction);
+	int16_t offset;
+	LinearSpace limits;
+	uint8_t inc_mode;
+	uint8_t inc_step;
+	uint8_t repeat;	// Consecutive steps in the same direction
+	int8_t last_direction;
+};
+
+#define MOD_SEGMENTS 16	// Modifier curve : 16 linear segments
+#define MOD_TABLE_SIZE (MOD_SEGMENTS + 1)
+
+// Modifier class : response curve (expo, rate or any custom curve) applied to the output space of the DataHandler.
+// The curve is a piecewise-linear table of MOD_TABLE_SIZE points evenly spread over [min ; max] :
+// per sample, one multiplication locates the segment (precomputed reciprocal of the range) and one more interpolates in it.
+// The table is regenerated (integer math only) when the curve parameters change, never in compute().
+// expo (0 -> 100 %) : y = (1 - expo) * x + expo * x^3, rate (0 -> 100 %) scales the result, x and y normalized around the center.
+class Modifier : public TransformElement
+{
+	public:
+	Modifier();
+	Modifier(int16_t min, int16_t max, uint8_t expo, uint8_t rate, uint8_t initial_bypass);
+	int16_t compute(int16_t input);
+	void set_ranges(int16_t min, int16_t max);
+	void set_expo(uint8_t n_expo);
+	void set_rate(uint8_t n_rate);
+	// Custom curve : MOD_TABLE_SIZE output values, from min to max (replaced by the expo curve again if ranges, expo or rate change)
+	void set_curve(const int16_t* points);
+	uint8_t get_expo();
+	uint8_t get_rate();
+	const int16_t* get_table();
+	private:
+	void build_table();
+	LinearSpace range;
+	uint8_t expo;
+	uint8_t rate;
+	uint32_t step_scale;	// 2^28 / (max - min) : (input - min) * step_scale >> 16 = segment index . 8 bits fraction
+	int16_t table[MOD_TABLE_SIZE];
+};
+
+#define DH_TABLE_SIZE 1024	// Lookup table covers the 10 bits adc range : inputs [0 ; DH_TABLE_SIZE - 1]
+
 // DataHandler class has 2 Linear spaces as input and output spaces.
 // It is used to linearly interpolate an input value and return an output value
+// The 32 bits division of the mapping is replaced by a fixed-point reciprocal computed once in set_ranges() :
+// output = out_min +/- ((|input - origin| * scale) >> shift), which gives exactly the same results
+// as the integer division for the samples of the converter : [0 ; DH_TABLE_SIZE - 1], widened to the input space
+// rounded up to a whole number of bits (e.g. [0 ; 4095] for the 12 bits of an oversampled input). Other inputs use the division.
+// For sensors whose ranges rarely change, a lookup table (SRAM or flash) can be used instead.
 class DataHandler : public TransformElement
 {
 	public:
@@ -58,37 +132,360 @@ class DataHandler : public TransformElement
 	DataHandler(int16_t in_min,int16_t in_max, int16_t out_min ,int16_t out_max ,uint8_t reverse);
 	// Linear interpolation (as linear mapping)
 	int16_t compute(int16_t input);
+	int16_t compute_exact(int16_t input);	// Reference mapping using the 32 bits division
 	//using TransformElement::compute;
 	// Linear Spaces initializers
 	void set_ranges(int16_t in_min,int16_t in_max, int16_t out_min, int16_t out_max);
 	const uint8_t is_reversed();
 	void reverse(uint8_t state);
+	// Lookup table modes (DH_TABLE_SIZE entries) :
+	// SRAM table is filled now and refilled each time ranges change
+	// Flash table (PROGMEM) must have been generated for the current ranges, it is dropped if ranges change
+	void use_ram_table(int16_t* table);
+	void use_flash_table(const int16_t* table);
+	void disable_table();
+	void fill_table(int16_t* table);	// Writes the DH_TABLE_SIZE results of the current mapping into table
+	uint8_t get_table_mode();
+	// Copies the fixed-point coefficients (used by SensorBank), returns 0 if the mapping needs the division
+	uint8_t get_coefficients(int16_t* n_origin, uint32_t* n_scale, uint8_t* n_shift, uint8_t* n_negate);
+	uint8_t get_affine(AffineMap* map);	// Fixed-point mapping over [fast_min ; fast_max] (not with a flash table)
 	// Custom getters to extract the input_space's and output_space's addresses
 	// Used for direct accessing
+	// Note : call set_ranges() to apply new boundaries, otherwise precomputed coefficients won't be updated
 	LinearSpace* get_input_space_ptr();
 	LinearSpace* get_output_space_ptr();
 
+	enum Table_Mode {NoTable, RamTable, FlashTable};
+
 	private:
+	void update_coefficients();	// Computes origin, scale, shift and sign from the spaces and reverse mode
 	LinearSpace input_space;
 	LinearSpace output_space;
 	uint8_t reverse_mode;
-	
+	int16_t origin;		// in_min (or in_max when reversed)
+	uint32_t scale;		// ceil(|out delta| * 2^shift / |in delta|)
+	uint8_t shift;
+	uint8_t negate;		// Sign of the slope (reverse mode folded in)
+	uint8_t fast_mode;	// 0 if the reciprocal can't be exact (huge ranges) -> division is used
+	int16_t fast_min;	// Inputs computed with the reciprocal
+	int16_t fast_max;
+	uint8_t table_mode;
+	const int16_t* table;
 };
 
+// Original 3 samples filter of the sensors (DataFilter, see below)
 #define DATA_FILTER_SIZE 3
-class DataFilter : public TransformElement {
+
+// DataFilter is one of the elements of the dispatch switch (-DTAGGED_ELEMENT_DISPATCH), the other moving averages are external
+template<uint8_t Size, typename Acc> struct MovingAverageBase {typedef ExternalElement type;};
+#ifdef TAGGED_ELEMENT_DISPATCH
+class DispatchedFilter : public TransformElement {
 	public:
-	DataFilter();
-	DataFilter(uint8_t init_bypass, int16_t initial_filter_v = 0);
+	DispatchedFilter(uint8_t init_bypass, T_Elmt_Key key) : TransformElement(init_bypass, key) {}
+};
+template<> struct MovingAverageBase<DATA_FILTER_SIZE, int16_t> {typedef DispatchedFilter type;};
+#endif
+
+// Moving average over the last Size samples, accumulated in Acc.
+// Power of two sizes : the division by Size becomes shifts and the ring index is wrapped with a mask (no % or division at all).
+// Acc must hold Size * max|input| : int16_t is enough for 3 x 10 bits samples, not for 64 of them.
+template<uint8_t Size, typename Acc = int32_t>
+class MovingAverage : public MovingAverageBase<Size, Acc>::type {
+	typedef typename MovingAverageBase<Size, Acc>::type Base;
+	public:
+	MovingAverage() : Base(0, TransformElement::DFilter), output(0), processing_iterator(0) {
+		attach_compute<MovingAverage>(this);
+		init_filter(0);
+	}
+	MovingAverage(uint8_t init_bypass, int16_t initial_filter_v = 0) : Base(init_bypass, TransformElement::DFilter),
+		output(initial_filter_v), processing_iterator(0) {
+		attach_compute<MovingAverage>(this);
+		init_filter(initial_filter_v);
+	}
+	int16_t compute(int16_t input)
+	{
+		sum = sum + input - sliding_array[processing_iterator];
+		sliding_array[processing_iterator] = input;
+		output = sum / Size;	// constant power of two : compiled as shifts
+		if(Size & (Size - 1)) {
+			processing_iterator++;
+			if(processing_iterator == Size) processing_iterator = 0;
+		}
+		else processing_iterator = (processing_iterator + 1) & (Size - 1);
+		return output;
+	}
+	void init_filter(int16_t init_value)
+	{
+		for(uint8_t i = 0; i < Size; i++) sliding_array[i] = init_value;
+		sum = (Acc) init_value * Size;
+	}
+	int16_t get_output() {return output;}
+	uint8_t is_stateful() {return stateful;}
+	uint16_t get_noise_gain() {return (256 + Size / 2) / Size;}	// 1 / Size
+	static const uint8_t stateful = 1;
+	private:
+	int16_t sliding_array[Size];
+	Acc sum;
+	int16_t output;
+	uint8_t processing_iterator;
+};
+
+// Original 3 samples filter of the sensors (same results as before)
+typedef MovingAverage<DATA_FILTER_SIZE, int16_t> DataFilter;
+
+// Exponential moving average : y += (x - y) / 2^Shift, i.e. alpha = 2^-Shift.
+// The state keeps Shift fractional bits, so small steps are not lost. One subtraction and two shifts per sample.
+template<uint8_t Shift>
+class EmaFilter : public ExternalElement {
+	public:
+	EmaFilter() : ExternalElement(0, DFilter) {
+		attach_compute<EmaFilter>(this);
+		init_filter(0);
+	}
+	EmaFilter(uint8_t init_bypass, int16_t initial_filter_v = 0) : ExternalElement(init_bypass, DFilter) {
+		attach_compute<EmaFilter>(this);
+		init_filter(initial_filter_v);
+	}
+	int16_t compute(int16_t input)
+	{
+		state += input - (state >> Shift);
+		return (int16_t)(state >> Shift);
+	}
+	void init_filter(int16_t init_value) {state = (int32_t) init_value << Shift;}
+	int16_t get_output() {return (int16_t)(state >> Shift);}
+	uint8_t is_stateful() {return stateful;}
+	uint16_t get_noise_gain() {return 256 / ((2 << Shift) - 1);}	// alpha / (2 - alpha)
+	static const uint8_t stateful = 1;
+	private:
+	int32_t state;	// y * 2^Shift
+};
+
+// Sliding median over the last Size samples (odd sizes : 3 rejects single sample spikes, 5 rejects two samples wide ones).
+// A sorted copy of the window is updated incrementally : the oldest sample is looked up and the new one slides into place,
+// O(Size) comparisons and moves per sample, no sorting and no division.
+template<uint8_t Size>
+class MedianFilter : public ExternalElement {
+	public:
+	MedianFilter() : ExternalElement(0, DMedian) {
+		attach_compute<MedianFilter>(this);
+		init_filter(0);
+	}
+	MedianFilter(uint8_t init_bypass, int16_t initial_filter_v = 0) : ExternalElement(init_bypass, DMedian) {
+		attach_compute<MedianFilter>(this);
+		init_filter(initial_filter_v);
+	}
+	int16_t compute(int16_t input)
+	{
+		int16_t oldest = sliding_array[processing_iterator];
+		sliding_array[processing_iterator] = input;
+		processing_iterator++;
+		if(processing_iterator == Size) processing_iterator = 0;
+		uint8_t i = 0;
+		while(sorted[i] != oldest) i++;	// The oldest sample is always in the sorted window
+		// Moves the hole left by the oldest sample to the place of the new one
+		while(i > 0 && sorted[i - 1] > input) {
+			sorted[i] = sorted[i - 1];
+			i--;
+		}
+		while(i < Size - 1 && sorted[i + 1] < input) {
+			sorted[i] = sorted[i + 1];
+			i++;
+		}
+		sorted[i] = input;
+		return sorted[Size / 2];
+	}
+	void init_filter(int16_t init_value)
+	{
+		for(uint8_t i = 0; i < Size; i++) {
+			sliding_array[i] = init_value;
+			sorted[i] = init_value;
+		}
+		processing_iterator = 0;
+	}
+	int16_t get_output() {return sorted[Size / 2];}
+	uint8_t is_stateful() {return stateful;}
+	// pi / (2 * Size) for gaussian noise (asymptotic, a little pessimistic for 3 or 5 samples)
+	uint16_t get_noise_gain() {return Size > 1 ? (402 + Size / 2) / Size : 256;}
+	static const uint8_t stateful = 1;
+	private:
+	int16_t sliding_array[Size];	// Samples in arrival order
+	int16_t sorted[Size];	// Same samples, sorted
+	uint8_t processing_iterator;
+};
+
+#define IIR_Q 14	// Fixed-point format of the IirFilter coefficients (1.0 = 1 << IIR_Q)
+// First order IIR : y[n] = b0 * x[n] + b1 * x[n-1] + a1 * y[n-1] (Q14 coefficients, rounded)
+// Defaults to a low pass filter with its pole at 0.75 and its zero at -1 : b0 = b1 = 0.125, a1 = 0.75 (unit gain)
+class IirFilter : public ExternalElement {
+	public:
+	IirFilter();
+	IirFilter(uint8_t init_bypass, int16_t initial_filter_v = 0);
 	int16_t compute(int16_t input);
+	void set_coefficients(int16_t n_b0, int16_t n_b1, int16_t n_a1);
 	void init_filter(int16_t init_value);
 	int16_t get_output();
+	uint8_t is_stateful() {return stateful;}
+	uint16_t get_noise_gain();	// Sum of the squares of the impulse response (0xFFFF when unstable)
+	static const uint8_t stateful = 1;
 	private:
-	int16_t sliding_array[DATA_FILTER_SIZE];
-	int16_t sum;
+	int16_t b0, b1, a1;
+	int16_t last_input;
 	int16_t output;
-	uint8_t processing_iterator;
-	
 };
 
+#ifndef NOISE_STATS_SAMPLES
+#define NOISE_STATS_SAMPLES 256	// Measurement length. Can be overriden from the compiler command line (-DNOISE_STATS_SAMPLES=n)
+#endif
+
+#if NOISE_STATS_SAMPLES > 256 || NOISE_STATS_SAMPLES < 2
+#error "NOISE_STATS_SAMPLES must be in [2 ; 256] (sum of squares of 12 bits deviations on 32 bits)"
+#endif
+
+// NoiseStats class : streaming mean and variance of its input, which is passed through unchanged.
+// Bypassed by default : enable it and restart() it with the sensor at rest, it stops by itself after NOISE_STATS_SAMPLES samples.
+// Samples are accumulated as deviations from the first one (shifted data) : the sums of d and d^2 are exact integers, which keeps
+// the numerical stability of Welford's update without its per sample division. Per sample : one subtraction, one 16 x 16 bits
+// multiplication and two additions. Mean and variance are only computed when they are read.
+class NoiseStats : public TransformElement {
+	public:
+	NoiseStats();
+	int16_t compute(int16_t input);
+	void restart();
+	uint16_t get_count();
+	uint8_t is_complete();
+	int16_t get_mean();	// Rounded
+	int16_t get_min();
+	int16_t get_max();
+	uint32_t get_variance(uint8_t averaged_samples = 1);	// Q8 (1/256 LSB^2). Variance of the mean of averaged_samples samples (white noise)
+	uint16_t get_std_dev(uint8_t averaged_samples = 1);	// Q4 (1/16 LSB)
+	uint32_t get_filtered_variance(uint16_t noise_gain);	// Q8. Variance after a filter of this noise gain (see get_noise_gain())
+	uint16_t get_filtered_std_dev(uint16_t noise_gain);	// Q4
+	uint8_t suggest_filter_size();	// Smallest power of two window (up to 64) bringing the standard deviation under 1/2 LSB
+	uint8_t is_stateful() {return stateful;}
+	static const uint8_t stateful = 1;	// Must see every sample
+	private:
+	uint64_t get_spread();	// n^2 * variance
+	int16_t reference;
+	int32_t sum;
+	uint32_t square_sum;
+	uint16_t count;
+	int16_t min;
+	int16_t max;
+};
+
+#define RADIAL_TABLE_SEGMENTS 32	// sqrt(1 + t^2) table : 32 linear segments over t in [0 ; 1]
+
+// RadialDeadzone class : 2D stage of a Gimbal (not a TransformElement : it takes and gives an X / Y pair).
+// Replaces the two square deadzones of the axes by a circle of radius "radius" around the centre, and maps the circular
+// travel of the stick to the whole output square (a stick pushed in a diagonal reaches the corner) :
+//   d = (x - centre, y - centre), m = max(|dx|, |dy|), r = |d| = m * sqrt(1 + (min(|dx|, |dy|) / m)^2)
+//   out = centre + d * (r - radius) / m * range / (range - radius), clamped to [centre - range ; centre + range]
+// sqrt(1 + t^2) is read from a PROGMEM table (linear interpolation) : one division (1 / m) and a few multiplications per pair.
+class RadialDeadzone
+{
+	public:
+	RadialDeadzone();
+	// range : half travel of the output (100 for [-100 ; 100]). radius in [0 ; range / 2], returns 0 if refused
+	uint8_t set_ranges(int16_t n_center, int16_t n_range, int16_t n_radius);
+	void compute(int16_t* x, int16_t* y);
+	int16_t get_center();
+	int16_t get_range();
+	int16_t get_radius();
+	private:
+	int16_t center;
+	int16_t range;
+	int16_t radius;
+	uint16_t gain;	// range / (range - radius), Q14
+};
+
+/************************************************************************/
+/* Per sample compute() of the sensor elements, inline : the dispatch  */
+/* switch of -DTAGGED_ELEMENT_DISPATCH calls them directly             */
+/************************************************************************/
+
+inline int16_t Deadzone::compute(int16_t input){
+	int16_t output = 0;
+	if(input < boundaries.get_max() && input > boundaries.get_min()) {
+		output = neutral;
+	}
+	else output = input;
+	return output;
+}
+
+// Offset is added after the mapping, saturated to 16 bits
+inline int16_t TrimHandler::compute(int16_t input)
+{
+	int32_t output = (int32_t) input + offset;
+	if(output > 32767) output = 32767;
+	if(output < -32768) output = -32768;
+	return (int16_t) output;
+}
+
+inline int16_t Modifier::compute(int16_t input)
+{
+	if(input <= range.get_min()) return table[0];
+	if(input >= range.get_max()) return table[MOD_SEGMENTS];
+	uint16_t position = ((uint32_t)(uint16_t)(input - range.get_min()) * step_scale + 0x8000) >> 16;	// rounded
+	uint8_t index = position >> 8;
+	uint8_t fraction = position & 0xFF;
+	if(index >= MOD_SEGMENTS) return table[MOD_SEGMENTS];
+	return table[index] + (int16_t)(((int32_t)(table[index + 1] - table[index]) * fraction + 0x80) >> 8);
+}
+
+// Hot path : table lookup or multiply + shift (no division)
+// Rough avr-gcc costs : 32 bits division (__divmodsi4) is several hundreds of cycles,
+// 32 bits multiplication (__mulsi3 with hardware MUL) a few tens.
+inline int16_t DataHandler::compute(int16_t input)
+{
+	if(table_mode != NoTable && input >= 0 && input < DH_TABLE_SIZE) {
+		if(table_mode == RamTable) return table[input];
+		return (int16_t) pgm_read_word(&table[input]);
+	}
+	if(!fast_mode || input < fast_min || input > fast_max) return compute_exact(input);
+	int16_t x = input - origin;
+	uint8_t neg = negate;
+	if(x < 0) {
+		x = -x;
+		neg = !neg;
+	}
+	int32_t intermediate = (int32_t)(((uint32_t)(uint16_t) x * scale) >> shift);
+	if(neg) intermediate = -intermediate;
+	intermediate += output_space.get_min();
+	return int16_t (intermediate);
+}
+
+inline int16_t NoiseStats::compute(int16_t input){
+	if(count >= NOISE_STATS_SAMPLES) return input;
+	if(count == 0) {
+		reference = input;
+		min = input;
+		max = input;
+	}
+	int16_t deviation = input - reference;
+	sum += deviation;
+	square_sum += (uint32_t)((int32_t) deviation * deviation);
+	count++;
+	if(input < min) min = input;
+	if(input > max) max = input;
+	return input;
+}
+
+#ifdef TAGGED_ELEMENT_DISPATCH
+// Forced inline in transform() of the pipelines (too big for the compiler to inline it by itself) : one jump through the
+// switch table and no call for the elements of the sensors. Costs a copy of their compute() in each pipeline class (flash)
+__attribute__((always_inline)) inline int16_t TransformElement::compute(int16_t input)
+{
+	switch(type) {
+		case DHandler : return static_cast<DataHandler*>(this)->compute(input);
+		case DFilter : return static_cast<DataFilter*>(this)->compute(input);
+		case DZone : return static_cast<Deadzone*>(this)->compute(input);
+		case Mod : return static_cast<Modifier*>(this)->compute(input);
+		case TrimH : return static_cast<TrimHandler*>(this)->compute(input);
+		case DStats : return static_cast<NoiseStats*>(this)->compute(input);
+		case DExternal : return static_cast<ExternalElement*>(this)->compute_fn(this, input);
+		default : return input;	// DMedian : MedianFilters are external elements
+	}
+}
+#endif
+
 #endif
\ No newline at end of file
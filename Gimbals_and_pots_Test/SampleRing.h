@@ -0,0 +1,75 @@
+/*
+Version |   date   |  description
+V 0.1   17/10/2026  Single producer / single consumer ring carrying adc samples from the ISR to the main loop
+*/
+
+#ifndef SAMPLE_RING
+#define SAMPLE_RING
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#ifndef SAMPLE_RING_SIZE
+#define SAMPLE_RING_SIZE 4	// Power of two. Can be overriden from the compiler command line (-DSAMPLE_RING_SIZE=n)
+#endif
+
+#if (SAMPLE_RING_SIZE & (SAMPLE_RING_SIZE - 1)) || SAMPLE_RING_SIZE > 128
+#error "SAMPLE_RING_SIZE must be a power of two (at most 128)"
+#endif
+
+// Lock-free ring of (value, time stamp) samples.
+// The ISR is the only writer of head, the main loop the only writer of tail : both indexes are 8 bits wide,
+// so they are read and written atomically on AVR and no interrupt has to be disabled (only the 16 bits lost counter needs it).
+// Indexes run freely (modulo 256), head - tail is the number of stored samples.
+// When the ring is full, new samples are dropped and counted (the oldest samples are kept, as the consumer may be reading them).
+class SampleRing
+{
+	public:
+		SampleRing() : head(0), tail(0), lost(0) {}
+
+		// Producer side (ISR)
+		uint8_t push(uint16_t value, uint16_t stamp)
+		{
+			uint8_t h = head;
+			if((uint8_t)(h - tail) >= SAMPLE_RING_SIZE) {
+				if(lost != 0xFFFF) lost++;
+				return 0;
+			}
+			values[h & (SAMPLE_RING_SIZE - 1)] = value;
+			stamps[h & (SAMPLE_RING_SIZE - 1)] = stamp;
+			head = h + 1;	// Publishes the sample once it is written
+			return 1;
+		}
+
+		// Consumer side (main loop)
+		uint8_t pop(uint16_t* value, uint16_t* stamp)
+		{
+			uint8_t t = tail;
+			if(t == head) return 0;
+			*value = values[t & (SAMPLE_RING_SIZE - 1)];
+			*stamp = stamps[t & (SAMPLE_RING_SIZE - 1)];
+			tail = t + 1;	// Frees the slot once it is read
+			return 1;
+		}
+
+		uint8_t get_count() {return (uint8_t)(head - tail);}
+		uint16_t get_lost()	// Samples dropped because the ring was full (saturates)
+		{
+			uint8_t sreg = SREG;	// 16 bits written by the ISR : read with interrupts masked
+			cli();
+			uint16_t n_lost = lost;
+			SREG = sreg;
+			return n_lost;
+		}
+		void clear() {tail = head;}	// Consumer side : forgets the stored samples
+
+	private:
+		volatile uint16_t values[SAMPLE_RING_SIZE];
+		volatile uint16_t stamps[SAMPLE_RING_SIZE];
+		volatile uint8_t head;
+		volatile uint8_t tail;
+		volatile uint16_t lost;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "SensorBank.h"
+#include "Sensors.h"	// Brings adc_tools.h
+#include <stddef.h>
+#include <avr/pgmspace.h>
+
+SensorBank::SensorBank() : sensor_nb(0), filter_index(0), round_ready(0), round_stamp(0) {}
+
+int8_t SensorBank::add_sensor(uint8_t n_mux)
+{
+	if(sensor_nb >= SENSOR_BANK_SIZE) return -1;
+	uint8_t index = sensor_nb;
+	mux[index] = n_mux;
+	flags[index] = FilterOn;
+	raw[index] = 0;
+	output[index] = 0;
+	for(uint8_t i = 0; i < DATA_FILTER_SIZE; i++) filter_window[i][index] = 0;
+	filter_sum[index] = 0;
+	dz_min[index] = 0;
+	dz_max[index] = 0;
+	dz_neutral[index] = 0;
+	if(!set_ranges(index, 0, 1023, -100, 100)) return -1;	// DataHandler defaults
+	sensor_nb++;
+	return index;
+}
+
+int8_t SensorBank::add_sensor(const SensorConfig* flash_config)
+{
+	int8_t index = add_sensor(pgm_read_byte(&flash_config->mux));
+	if(index < 0) return -1;
+	uint8_t bypass_mask = pgm_read_byte(&flash_config->bypass_mask);
+	if(!set_ranges(index, pgm_read_word(&flash_config->in_min), pgm_read_word(&flash_config->in_max),
+				   pgm_read_word(&flash_config->out_min), pgm_read_word(&flash_config->out_max))) {
+		sensor_nb--;	// Last one added
+		return -1;
+	}
+	set_deadzone(index, pgm_read_word(&flash_config->dz_min), pgm_read_word(&flash_config->dz_max),
+				 pgm_read_word(&flash_config->dz_neutral), (bypass_mask & SENSOR_BYPASS(DZone)) != 0);
+	set_bypass(index, TransformElement::DFilter, (bypass_mask & SENSOR_BYPASS(DFilter)) != 0);
+	return index;
+}
+
+// Coefficients are computed by a DataHandler, so that both give the same results
+uint8_t SensorBank::set_ranges(uint8_t index, int16_t in_min, int16_t in_max, int16_t n_out_min, int16_t out_max, uint8_t reverse)
+{
+	if(index >= SENSOR_BANK_SIZE) return 0;
+	DataHandler handler(in_min, in_max, n_out_min, out_max, reverse);
+	int16_t n_origin;
+	uint32_t n_scale;
+	uint8_t n_shift, n_negate;
+	if(!handler.get_coefficients(&n_origin, &n_scale, &n_shift, &n_negate)) return 0;	// Would need the division
+	origin[index] = n_origin;
+	scale[index] = n_scale;
+	shift[index] = n_shift;
+	negate[index] = n_negate;
+	out_min[index] = n_out_min;
+	return 1;
+}
+
+uint8_t SensorBank::set_deadzone(uint8_t index, int16_t min, int16_t max, int16_t neutral, uint8_t bypass)
+{
+	if(index >= sensor_nb || neutral < 0 || neutral >= DH_TABLE_SIZE) return 0;
+	dz_min[index] = min;
+	dz_max[index] = max;
+	dz_neutral[index] = neutral;
+	set_bypass(index, TransformElement::DZone, bypass);
+	return 1;
+}
+
+void SensorBank::set_bypass(uint8_t index, TransformElement::T_Elmt_Key element, uint8_t byp)
+{
+	if(index >= sensor_nb) return;
+	uint8_t flag = 0;
+	if(element == TransformElement::DFilter) flag = FilterOn;
+	if(element == TransformElement::DZone) flag = DeadzoneOn;
+	if(byp) flags[index] &= ~flag;
+	else flags[index] |= flag;
+}
+
+uint8_t SensorBank::send_adc_requests(Adc* adc)
+{
+	if(round_ready || sensor_nb == 0) return 0;	// Previous round not processed yet
+	return adc->start_bank_round(this);
+}
+
+// Same chain as Axis (DataFilter -> Deadzone -> DataHandler), one sensor after the other in a single loop
+uint8_t SensorBank::update()
+{
+	if(!round_ready) return 0;
+	for(uint8_t i = 0; i < sensor_nb; i++)
+	{
+		int16_t value = raw[i];
+		if(flags[i] & FilterOn) {
+			filter_sum[i] = filter_sum[i] + value - filter_window[filter_index][i];
+			filter_window[filter_index][i] = value;
+			value = filter_sum[i] / DATA_FILTER_SIZE;
+		}
+		if((flags[i] & DeadzoneOn) && value < dz_max[i] && value > dz_min[i]) value = dz_neutral[i];
+		int16_t x = value - origin[i];
+		uint8_t neg = negate[i];
+		if(x < 0) {
+			x = -x;
+			neg = !neg;
+		}
+		int32_t intermediate = (int32_t)(((uint32_t)(uint16_t) x * scale[i]) >> shift[i]);
+		if(neg) intermediate = -intermediate;
+		output[i] = (int16_t)(intermediate + out_min[i]);
+	}
+	filter_index = (filter_index + 1) % DATA_FILTER_SIZE;
+	round_ready = 0;	// ISR may start writing the next round
+	return sensor_nb;
+}
+
+int16_t SensorBank::read_sensor(uint8_t index) {return output[index];}
+uint16_t SensorBank::get_adc_result(uint8_t index) {return raw[index];}
+uint16_t SensorBank::get_round_stamp() {return round_stamp;}
+uint8_t SensorBank::get_sensor_nb() {return sensor_nb;}
+uint8_t SensorBank::get_mux(uint8_t index) {return mux[index];}
+void SensorBank::set_sample(uint8_t index, uint16_t value) {raw[index] = value;}
+void SensorBank::round_complete(uint16_t stamp)
+{
+	round_stamp = stamp;
+	round_ready = 1;
+}
@@ -0,0 +1,82 @@
+/*
+Version |   date   |  description
+V 0.1   17/10/2026  Structure of arrays version of the analog inputs (batch requests and batch update)
+*/
+
+#ifndef SENSOR_BANK
+#define SENSOR_BANK
+
+#include <stdint.h>
+#include "S_PipeElement.h"
+#include "SensorConfig.h"
+
+#ifndef SENSOR_BANK_SIZE
+#define SENSOR_BANK_SIZE 8	// Can be overriden from the compiler command line (-DSENSOR_BANK_SIZE=n)
+#endif
+
+class Adc;
+
+// SensorBank holds N analog inputs in contiguous arrays instead of N AnalogSensor objects
+// (each one dragging its own DataFilter, Deadzone, DataHandler, AdcHandler and TransformPipeline).
+// Every sensor runs the same chain as an Axis : DataFilter -> Deadzone -> DataHandler, with the same results.
+//  -> send_adc_requests() issues one round of conversions : the ISR converts each sensor once, in order,
+//     chaining the channels by itself (see Adc::start_bank_round())
+//  -> update() processes the whole round in a single pass over the arrays (no virtual call, no memoization bookkeeping)
+// The next round is only started once the previous one has been processed, so the ISR never writes a sample
+// the main loop is reading.
+// The mapping always uses the DataHandler fixed-point reciprocal : ranges which would need the 32 bits division
+// are refused, as well as deadzone neutral values outside of the adc range.
+class SensorBank
+{
+	public:
+		SensorBank();
+
+		// Adds a sensor converted on adc mux n_mux, returns its index (-1 if the bank is full)
+		// Defaults are the ones of an Axis : ranges [0 ; 1023] -> [-100 ; 100], filter on, no deadzone
+		int8_t add_sensor(uint8_t n_mux);
+		// Adds a sensor with the settings of a flash table (see SensorConfig.h) : mux, ranges, deadzone, DFilter / DZone bypass.
+		// Returns -1 if the bank is full or if the ranges would need the division
+		int8_t add_sensor(const SensorConfig* flash_config);
+		uint8_t set_ranges(uint8_t index, int16_t in_min, int16_t in_max, int16_t out_min, int16_t out_max, uint8_t reverse = 0);
+		uint8_t set_deadzone(uint8_t index, int16_t min, int16_t max, int16_t neutral, uint8_t bypass = 0);
+		void set_bypass(uint8_t index, TransformElement::T_Elmt_Key element, uint8_t byp);	// DFilter or DZone
+
+		uint8_t send_adc_requests(Adc* adc);	// Starts a round of conversions, returns 0 if it couldn't be started
+		uint8_t update();	// Processes the last complete round, returns the number of processed sensors
+		int16_t read_sensor(uint8_t index);
+		uint16_t get_adc_result(uint8_t index);	// Raw sample of the last round
+		uint16_t get_round_stamp();	// Time stamp of the end of the last round (ADC_TIMESTAMP)
+
+		// ISR side (Adc)
+		uint8_t get_sensor_nb();
+		uint8_t get_mux(uint8_t index);
+		void set_sample(uint8_t index, uint16_t value);
+		void round_complete(uint16_t stamp);
+
+		enum Bank_Flags {FilterOn = 1, DeadzoneOn = 2};
+
+	private:
+		uint8_t sensor_nb;
+		uint8_t mux[SENSOR_BANK_SIZE];
+		uint8_t flags[SENSOR_BANK_SIZE];
+		volatile uint16_t raw[SENSOR_BANK_SIZE];
+		int16_t output[SENSOR_BANK_SIZE];
+		// DataFilter state : sensors are processed in lockstep (one sample each per round), so the window index is shared
+		int16_t filter_window[DATA_FILTER_SIZE][SENSOR_BANK_SIZE];
+		int16_t filter_sum[SENSOR_BANK_SIZE];
+		uint8_t filter_index;
+		// Deadzone
+		int16_t dz_min[SENSOR_BANK_SIZE];
+		int16_t dz_max[SENSOR_BANK_SIZE];
+		int16_t dz_neutral[SENSOR_BANK_SIZE];
+		// DataHandler coefficients : out_min +/- ((|input - origin| * scale) >> shift)
+		int16_t origin[SENSOR_BANK_SIZE];
+		uint32_t scale[SENSOR_BANK_SIZE];
+		uint8_t shift[SENSOR_BANK_SIZE];
+		uint8_t negate[SENSOR_BANK_SIZE];
+		int16_t out_min[SENSOR_BANK_SIZE];
+		volatile uint8_t round_ready;	// A complete round waits for update()
+		volatile uint16_t round_stamp;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+Version |   date   |  description
+V 0.1   17/10/2026  Sensor settings described by constant tables (flash), validated at compile time
+*/
+
+#ifndef SENSOR_CONFIG
+#define SENSOR_CONFIG
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include "TransformPipeline.h"
+
+// Bypass mask bit of an element : SENSOR_BYPASS(DZone) | SENSOR_BYPASS(Mod)...
+#define SENSOR_BYPASS(key) (1 << TransformElement::key)
+#define AXIS_DEFAULT_BYPASS (SENSOR_BYPASS(Mod) | SENSOR_BYPASS(DStats))	// Same as Axis() : linear response, no noise measurement
+#define POT_DEFAULT_BYPASS SENSOR_BYPASS(DZone)	// Potentiometers have no deadzone stage
+
+// Settings of an Axis or a Potentiometer (a SensorBank input), read by their constructors from flash.
+// The gain is the compile time validation below : the sensors still copy the settings to SRAM and compute their coefficients
+// and curve tables, so startup costs about the same as the setter calls (see config_bench).
+// Fields are listed in declaration order, to be used as an aggregate :
+//  constexpr SensorConfig throttle PROGMEM = {ADC4D, 0, 1023, -100, 100, 0, 0, 0, POT_DEFAULT_BYPASS, 0, 0};
+// The filter is the built-in DataFilter, SENSOR_BYPASS(DFilter) removes it. The other filters are given at runtime (set_filter()).
+struct SensorConfig
+{
+	uint8_t mux;	// ADCxD
+	uint16_t in_min;	// DataHandler input space (raw samples)
+	uint16_t in_max;
+	int16_t out_min;	// DataHandler output space
+	int16_t out_max;
+	uint16_t dz_min;	// Deadzone (Axis and SensorBank), in the input space
+	uint16_t dz_max;
+	uint16_t dz_neutral;
+	uint8_t bypass_mask;	// SENSOR_BYPASS() bits of the bypassed elements
+	uint8_t priority;	// HardwareActuator priority : weight - 1 of the channel with -DADC_PRIORITY_SCHEDULER
+	uint8_t oversampling;	// AdcHandler::set_oversampling() : 4^n conversions per result, ranges on 10 + n bits.
+							// Neither is used by a SensorBank (scan mode)
+};
+
+// Both axes of a Gimbal, plus its joint settings
+struct GimbalConfig
+{
+	SensorConfig x;
+	SensorConfig y;
+	uint8_t paired;	// Gimbal::set_paired_requests()
+	int16_t radial_radius;	// Gimbal::set_radial_deadzone(), 0 keeps the square deadzones of the axes
+};
+
+#if __cplusplus >= 201103L
+// Compile time checks (C++11, tables declared constexpr), e.g. static_assert(is_valid_config(throttle), "throttle settings") :
+//  -> mux is one of the 8 adc channels (ADC6 and ADC7 : TQFP and QFN packages only), non empty input and output spaces
+//  -> deadzone inside the input space, neutral value inside the deadzone (unless the deadzone is bypassed)
+//  -> oversampling up to ADC_MAX_OVERSAMPLING, input space within the 10 + n bits of the results
+const uint8_t config_max_oversampling = 3;	// ADC_MAX_OVERSAMPLING (adc_tools.h isn't included by SensorBank.h)
+constexpr uint8_t is_valid_config(const SensorConfig& config)
+{
+	return config.mux < 8 && config.in_min < config.in_max && config.out_min != config.out_max &&
+		   config.oversampling <= config_max_oversampling && config.in_max <= (1023 << config.oversampling) &&
+		   ((config.bypass_mask & SENSOR_BYPASS(DZone)) ||
+			(config.in_min <= config.dz_min && config.dz_min <= config.dz_neutral && config.dz_neutral <= config.dz_max &&
+			 config.dz_max <= config.in_max));
+}
+
+// Both axes are valid, on two different channels, and share their output space in radial mode
+constexpr uint8_t is_valid_config(const GimbalConfig& config)
+{
+	return is_valid_config(config.x) && is_valid_config(config.y) && config.x.mux != config.y.mux && config.radial_radius >= 0 &&
+		   (config.radial_radius == 0 || (config.x.out_min == config.y.out_min && config.x.out_max == config.y.out_max));
+}
+
+// Every sensor of a table is valid and converted on its own channel
+template<uint8_t N> constexpr uint8_t mux_used_once(const SensorConfig (&configs)[N], uint8_t i, uint8_t j = 0)
+{
+	return j >= N || ((j == i || configs[j].mux != configs[i].mux) && mux_used_once(configs, i, j + 1));
+}
+template<uint8_t N> constexpr uint8_t are_valid_configs(const SensorConfig (&configs)[N], uint8_t i = 0)
+{
+	return i >= N || (is_valid_config(configs[i]) && mux_used_once(configs, i) && are_valid_configs(configs, i + 1));
+}
+#endif
+
+#endif
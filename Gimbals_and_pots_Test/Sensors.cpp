@@ -7,6 +7,8 @@
 #include "S_PipeElement.h"
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 
 /************************************************************************/
@@ -27,29 +29,78 @@ uint8_t HardwareActuator::get_priority()const    {return priority;}
 /************************************************************************/
 
 
-AnalogSensor::AnalogSensor() : HardwareActuator(), data_handler(),adc_handler(),sensor_value(0),
-							 adc_result(0),calibration_mode(0), pipe()    {}
+AnalogSensor::AnalogSensor() : HardwareActuator(), data_handler(),active_filter(&filter),adc_handler(),sensor_value(0),
+							 adc_result(0),calibration_mode(0),calibration_min(0),calibration_max(0), pipe(), samples(), sample_stamp(0)    {}
 
 AnalogSensor::AnalogSensor(uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max,
 						   uint16_t result, uint16_t input, uint8_t hard_priority , uint8_t phy_port ) :
 								HardwareActuator(phy_port , hard_priority) , data_handler(in_min,in_max,out_min,out_max,0),
-								adc_handler(), sensor_value(0),adc_result(0),calibration_mode(0),pipe() {}
+								active_filter(&filter), adc_handler(), sensor_value(0),adc_result(0),calibration_mode(0),calibration_min(0),
+								calibration_max(0),pipe(), samples(), sample_stamp(0) {}
 
-void AnalogSensor::set_adc_result(uint16_t n_result) {
+// Elements are built with the settings of the table (copied to SRAM, coefficients computed as by the setters)
+AnalogSensor::AnalogSensor(const SensorConfig* flash_config) : HardwareActuator(0, pgm_read_byte(&flash_config->priority)),
+								data_handler((int16_t) pgm_read_word(&flash_config->in_min), (int16_t) pgm_read_word(&flash_config->in_max),
+											 (int16_t) pgm_read_word(&flash_config->out_min), (int16_t) pgm_read_word(&flash_config->out_max), 0),
+								active_filter(&filter), adc_handler(), sensor_value(0),adc_result(0),calibration_mode(0),calibration_min(0),
+								calibration_max(0),pipe(), samples(), sample_stamp(0) {
+	uint8_t bypass_mask = pgm_read_byte(&flash_config->bypass_mask);
+	adc_handler.set_adc_mux(pgm_read_byte(&flash_config->mux));
+	adc_handler.set_oversampling(pgm_read_byte(&flash_config->oversampling));
+	filter.set_bypass((bypass_mask & SENSOR_BYPASS(DFilter)) != 0);
+	data_handler.set_bypass((bypass_mask & SENSOR_BYPASS(DHandler)) != 0);
+}
+
+AnalogSensor::AnalogSensor(const AnalogSensor& other) : HardwareActuator(other), data_handler(other.data_handler), filter(other.filter),
+								active_filter(&filter), adc_handler(other.adc_handler), sensor_value(other.sensor_value), adc_result(other.adc_result),
+								calibration_mode(other.calibration_mode), calibration_min(other.calibration_min), calibration_max(other.calibration_max),
+								pipe(), samples(), sample_stamp(other.sample_stamp) {}
+
+void AnalogSensor::set_adc_result(uint16_t n_result, uint16_t stamp) {
 	adc_result = n_result;
-	conv_success = 1;
+	samples.push(n_result, stamp);
 	}
-uint16_t AnalogSensor::get_adc_result() {return adc_result;}
-void AnalogSensor::update_result() { 
-	if(conv_success){	// If we get the result of a new adc request, then compute stuff
-		 sensor_value = pipe.transform(adc_result);
-		 conv_success = 0;
-	}	// Otherwise, discard update.	
+uint16_t AnalogSensor::get_adc_result() {
+	uint8_t sreg = SREG;	// 16 bits written by the ISR : read with interrupts masked
+	cli();
+	uint16_t result = adc_result;
+	SREG = sreg;
+	return result;
+}
+// Every converted sample goes through the pipeline exactly once, oldest first (DataFilter sees evenly spaced data)
+uint8_t AnalogSensor::update_result() {
+	uint8_t processed = 0;
+	uint16_t sample;
+	while(samples.pop(&sample, &sample_stamp)){
+		 if(calibration_mode) {
+			 if(sample < calibration_min) calibration_min = sample;
+			 if(sample > calibration_max) calibration_max = sample;
+		 }
+		 sensor_value = pipe.transform(sample);
+		 processed++;
+	}	// No new sample : nothing to compute
+	return processed;
 }
+uint16_t AnalogSensor::get_sample_stamp() {return sample_stamp;}
+uint16_t AnalogSensor::get_lost_samples() {return samples.get_lost();}
 
 void AnalogSensor::set_ranges(uint16_t in_min,uint16_t in_max, uint16_t out_min, uint16_t out_max) {data_handler.set_ranges(in_min,in_max,out_min,out_max);}
 const int16_t AnalogSensor::read_sensor() {return sensor_value;}
-void AnalogSensor::calibrate(uint8_t state) {calibration_mode = state;}
+const uint16_t calibration_min_span = 64;	// Smaller spans are considered as "sensor didn't move" and are discarded
+
+void AnalogSensor::calibrate(uint8_t state) {
+	if(state && !calibration_mode) {
+		calibration_min = 0xFFFF;
+		calibration_max = 0;
+	}
+	if(!state && calibration_mode && calibration_max >= calibration_min + calibration_min_span) {
+		LinearSpace* output_space = data_handler.get_output_space_ptr();
+		data_handler.set_ranges(calibration_min, calibration_max, output_space->get_min(), output_space->get_max());
+	}
+	calibration_mode = state;
+}
+uint16_t AnalogSensor::get_calibration_min() {return calibration_min;}
+uint16_t AnalogSensor::get_calibration_max() {return calibration_max;}
 uint8_t AnalogSensor::get_adc_mux() {return adc_handler.get_mux();}
 void AnalogSensor::set_adc_mux(uint8_t n_mux){
 	adc_handler.set_adc_mux(n_mux);
@@ -59,9 +110,54 @@ void AnalogSensor::clear_adc_request(Adc* adc) {adc_handler.clear_adc_req(adc, t
 void AnalogSensor::set_max_adc_req(uint8_t max_req){adc_handler.set_max_adc_req_nb(max_req);}
 	
 
+#ifdef SHARED_PIPELINE_TOPOLOGY
+// One chain description per sensor class, described by the first sensor built
+PipelineTopology analog_topology;
+PipelineTopology axis_topology;
+#endif
+
 void AnalogSensor::init_pipeline(){
+#ifdef STATIC_TRANSFORM_PIPELINE
+	pipe.set_elements(NULL, &filter, NULL, &data_handler, NULL, NULL);
+#elif defined(SHARED_PIPELINE_TOPOLOGY)
+	if(!analog_topology.is_built()) {
+		analog_topology.add_indirect_stage(&pipe, &active_filter);
+		analog_topology.add_stage(&pipe, &data_handler);
+	}
+	pipe.set_topology(&analog_topology);
+#else
 	pipe.add_element(&filter);
 	pipe.add_element(&data_handler);
+#endif
+}
+
+uint8_t AnalogSensor::set_filter(TransformElement* n_filter){
+#ifdef STATIC_TRANSFORM_PIPELINE
+	return 0;
+#elif defined(SHARED_PIPELINE_TOPOLOGY)
+	// The filter stage is indirect : the topology reads active_filter
+	if(n_filter == NULL) n_filter = &filter;
+	if(!n_filter->is_stateful()) return 0;	// Stateful stage in the shared topology
+	active_filter->attach(NULL, 0);
+	active_filter = n_filter;
+	pipe.attach_elements();	// The new filter reports its changes to this pipeline
+	return 1;
+#else
+	if(n_filter == NULL) n_filter = &filter;
+	if(!pipe.replace_element(active_filter, n_filter)) return 0;
+	active_filter = n_filter;
+	return 1;
+#endif
+}
+
+uint8_t AnalogSensor::remove_stage(TransformElement* stage, ElementArena* arena){
+#if defined(STATIC_TRANSFORM_PIPELINE) || defined(SHARED_PIPELINE_TOPOLOGY)
+	(void) stage;
+	(void) arena;
+	return 0;
+#else
+	return pipe.destroy_element(stage, arena);
+#endif
 }
 
 // Sets the bypass value for a targeted TransformElement
@@ -73,11 +169,13 @@ void AnalogSensor::set_bypass(TransformElement::T_Elmt_Key element, uint8_t byp)
 		data_handler.set_bypass(byp);
 		break;
 		case TransformElement::DFilter :
-		filter.set_bypass(byp);
+		active_filter->set_bypass(byp);
 		break;
 		case TransformElement::Mod :
 		//modifier.set_bypass(byp);
 		break;
+		default:	// Axis elements (DZone, TrimH, DStats), added stages : see their own pointers
+		break;
 	}
 }
 
@@ -88,7 +186,7 @@ uint8_t AnalogSensor::is_bypassed(TransformElement::T_Elmt_Key element){
 		return data_handler.is_bypassed();
 		break;
 		case TransformElement::DFilter :
-		return filter.is_bypassed();
+		return active_filter->is_bypassed();
 		break;
 		case TransformElement::Mod :
 		//return modifier.is_bypassed();
@@ -108,19 +206,50 @@ AdcHandler* AnalogSensor::get_adc_handler_ptr() {return &adc_handler;}
 /************************************************************************/
 /* Axis class implementation                                            */
 /************************************************************************/
-Axis::Axis():AnalogSensor(),deadzone(){
+Axis::Axis():AnalogSensor(),modifier(),deadzone(){
+	modifier.set_bypass(1);	// Linear response until a curve is set
 	init_pipeline();
 }
 Axis::Axis(uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max, uint16_t result, uint16_t input, uint8_t hard_priority , uint8_t phy_port ):
-		AnalogSensor(in_min,in_max,out_min, out_max , result, input, hard_priority, phy_port),deadzone(){
+		AnalogSensor(in_min,in_max,out_min, out_max , result, input, hard_priority, phy_port),
+		modifier(out_min, out_max, 0, 100, 1),deadzone(){
 		init_pipeline();
 		}
+Axis::Axis(const Axis& other) : AnalogSensor(other), noise_stats(other.noise_stats), modifier(other.modifier), trim(other.trim),
+		deadzone(other.deadzone){
+	init_pipeline();
+}
+Axis::Axis(const SensorConfig* flash_config) : AnalogSensor(flash_config),
+		modifier((int16_t) pgm_read_word(&flash_config->out_min), (int16_t) pgm_read_word(&flash_config->out_max), 0, 100,
+				 (pgm_read_byte(&flash_config->bypass_mask) & SENSOR_BYPASS(Mod)) != 0),
+		deadzone(pgm_read_word(&flash_config->dz_min), pgm_read_word(&flash_config->dz_max), pgm_read_word(&flash_config->dz_neutral),
+				 (pgm_read_byte(&flash_config->bypass_mask) & SENSOR_BYPASS(DZone)) != 0){
+	uint8_t bypass_mask = pgm_read_byte(&flash_config->bypass_mask);
+	noise_stats.set_bypass((bypass_mask & SENSOR_BYPASS(DStats)) != 0);
+	trim.set_bypass((bypass_mask & SENSOR_BYPASS(TrimH)) != 0);
+	init_pipeline();
+}
 void Axis::init_pipeline(){
+#ifdef STATIC_TRANSFORM_PIPELINE
+	pipe.set_elements(&noise_stats, &filter, &deadzone, &data_handler, &trim, &modifier);
+#elif defined(SHARED_PIPELINE_TOPOLOGY)
+	if(!axis_topology.is_built()) {
+		axis_topology.add_stage(&pipe, &noise_stats);
+		axis_topology.add_indirect_stage(&pipe, &active_filter);
+		axis_topology.add_stage(&pipe, &deadzone);
+		axis_topology.add_stage(&pipe, &data_handler);
+		axis_topology.add_stage(&pipe, &trim);
+		axis_topology.add_stage(&pipe, &modifier);
+	}
+	pipe.set_topology(&axis_topology);
+#else
+	pipe.add_element(&noise_stats);
 	pipe.add_element(&filter);
 	pipe.add_element(&deadzone);
 	pipe.add_element(&data_handler);
-	//pipe.add_element(&trim);
-	//pipe.add_element(&modifiers);
+	pipe.add_element(&trim);
+	pipe.add_element(&modifier);
+#endif
 }
 void Axis::set_deadzone(uint16_t min,uint16_t max,uint16_t init_neutral,uint8_t init_bypass){
 	deadzone.set_ranges(min,max);
@@ -128,16 +257,62 @@ void Axis::set_deadzone(uint16_t min,uint16_t max,uint16_t init_neutral,uint8_t
 	deadzone.set_bypass(init_bypass);
 }
 
+void Axis::calibrate(uint8_t state){
+	if(!state && calibration_mode && calibration_max >= calibration_min + calibration_min_span) {
+		// Deadzone follows the rest position, its neutral value is the middle of the new input space (output centre)
+		uint16_t half_width = (deadzone.get_deadzone_max() - deadzone.get_deadzone_min()) / 2;
+		uint16_t rest = get_adc_result();
+		deadzone.set_ranges(rest > half_width ? rest - half_width : 0, rest + half_width);
+		deadzone.set_neutral((calibration_min + calibration_max) / 2);
+	}
+	AnalogSensor::calibrate(state);
+}
+
+uint8_t Axis::measure_noise(uint8_t state){
+	if(state) {
+		noise_stats.restart();
+		noise_stats.set_bypass(0);
+		return 0;
+	}
+	noise_stats.set_bypass(1);
+	if(!noise_stats.is_complete()) return 0;
+	// Filtering is useless under 1 LSB of noise (256 in Q8)
+	uint8_t filtered = noise_stats.get_variance() >= 256;
+	active_filter->set_bypass(!filtered);
+	// Whatever filter is installed (set_filter()) : the deadzone sees its output
+	uint16_t noise_gain = filtered ? active_filter->get_noise_gain() : 256;
+	uint16_t half_width = (3 * (uint32_t) noise_stats.get_filtered_std_dev(noise_gain) + 15) / 16 + 1;
+	int32_t rest = noise_stats.get_mean();
+	// Clamped to the input space, like calibrate()
+	LinearSpace* input_space = data_handler.get_input_space_ptr();
+	int32_t low = input_space->get_min() < input_space->get_max() ? input_space->get_min() : input_space->get_max();
+	int32_t high = input_space->get_min() < input_space->get_max() ? input_space->get_max() : input_space->get_min();
+	deadzone.set_ranges(rest - half_width > low ? rest - half_width : low, rest + half_width < high ? rest + half_width : high);
+	deadzone.set_neutral(rest < low ? low : (rest > high ? high : rest));
+	deadzone.set_bypass(0);
+	return 1;
+}
+uint8_t Axis::suggest_filter_size() {return noise_stats.is_complete() ? noise_stats.suggest_filter_size() : 0;}
+
+Deadzone* Axis::get_deadzone_ptr() {return &deadzone;}
+NoiseStats* Axis::get_noise_stats_ptr() {return &noise_stats;}
+TrimHandler* Axis::get_trim_handler_ptr() {return &trim;}
+Modifier* Axis::get_modifier_ptr() {return &modifier;}
+
 uint8_t Axis::is_bypassed(TransformElement::T_Elmt_Key element){
 	
-	if(element != TransformElement::DZone && element != TransformElement::TrimH) {
+	if(element != TransformElement::DZone && element != TransformElement::TrimH && element != TransformElement::Mod &&
+	   element != TransformElement::DStats) {
 	return AnalogSensor::is_bypassed(element);
 	}
 	else switch(element)
 	{
+	case(TransformElement::DStats):
+		return noise_stats.is_bypassed();
 	case(TransformElement::TrimH):
-		//return trim.is_bypassed();
-		break;
+		return trim.is_bypassed();
+	case(TransformElement::Mod):
+		return modifier.is_bypassed();
 	case(TransformElement::DZone):
 		return deadzone.is_bypassed();
 	default:
@@ -148,16 +323,26 @@ return 0;
 }
 
 void Axis::set_bypass(TransformElement::T_Elmt_Key element, uint8_t byp){
-	if(element != TransformElement::DZone && element != TransformElement::TrimH) {
+	if(element != TransformElement::DZone && element != TransformElement::TrimH && element != TransformElement::Mod &&
+	   element != TransformElement::DStats) {
 		AnalogSensor::set_bypass(element,byp);
 	}
 	else switch(element)
 	{
+		case(TransformElement::DStats):
+		noise_stats.set_bypass(byp);
+		break;
 		case(TransformElement::TrimH):
-		//trim.set_bypass(byp);
+		trim.set_bypass(byp);
+		break;
+		case(TransformElement::Mod):
+		modifier.set_bypass(byp);
 		break;
 		case(TransformElement::DZone):
 			deadzone.set_bypass(byp);
+		break;
+		default:
+		break;
 	}
 }
 
@@ -168,29 +353,129 @@ void Axis::set_bypass(TransformElement::T_Elmt_Key element, uint8_t byp){
 Potentiometer::Potentiometer():AnalogSensor(){init_pipeline();}
 Potentiometer::Potentiometer(uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max,uint16_t result, uint16_t input, uint8_t hard_priority , uint8_t phy_port) :
 								AnalogSensor(in_min, in_max, out_min, out_max, result, input, hard_priority, phy_port) {init_pipeline();}
+Potentiometer::Potentiometer(const SensorConfig* flash_config) : AnalogSensor(flash_config) {init_pipeline();}
+Potentiometer::Potentiometer(const Potentiometer& other) : AnalogSensor(other) {init_pipeline();}
 
 
 /************************************************************************/
 /* Gimbal class implementation                                          */
 /************************************************************************/
 
-Gimbal::Gimbal() : x_axis() , y_axis() {}
-Gimbal::Gimbal(Axis &x , Axis &y) : x_axis(x) , y_axis(y) {}
+Gimbal::Gimbal() : x_axis() , y_axis() , radial() , radial_mode(0) , x_output(0) , y_output(0) , x_bypass(0) , y_bypass(0) , pair() , paired(0)
+{
+	pair.add_sensor(&x_axis);
+	pair.add_sensor(&y_axis);
+}
+Gimbal::Gimbal(Axis &x , Axis &y) : x_axis(x) , y_axis(y) , radial() , radial_mode(0) , x_output(0) , y_output(0) , x_bypass(0) , y_bypass(0) , pair() , paired(0)
+{
+	pair.add_sensor(&x_axis);
+	pair.add_sensor(&y_axis);
+}
+Gimbal::Gimbal(const GimbalConfig* flash_config) : x_axis(&flash_config->x) , y_axis(&flash_config->y) , radial() , radial_mode(0) ,
+		x_output(0) , y_output(0) , x_bypass(0) , y_bypass(0) , pair() , paired(pgm_read_byte(&flash_config->paired))
+{
+	pair.add_sensor(&x_axis);
+	pair.add_sensor(&y_axis);
+	int16_t radius = (int16_t) pgm_read_word(&flash_config->radial_radius);
+	if(radius) set_radial_deadzone(radius);
+}
 void Gimbal::calibrate(uint8_t state){
 	x_axis.calibrate(state);
 	y_axis.calibrate(state);
 }
+uint8_t Gimbal::measure_noise(uint8_t state){
+	uint8_t x_sized = x_axis.measure_noise(state);
+	uint8_t y_sized = y_axis.measure_noise(state);
+	if(radial_mode) {	// The sized deadzones are used again by set_radial_deadzone(0, 0)
+		if(x_sized) {
+			x_bypass &= ~SENSOR_BYPASS(DZone);
+			x_axis.set_bypass(TransformElement::DZone, 1);
+		}
+		if(y_sized) {
+			y_bypass &= ~SENSOR_BYPASS(DZone);
+			y_axis.set_bypass(TransformElement::DZone, 1);
+		}
+	}
+	return x_sized && y_sized;
+}
+uint8_t Gimbal::suggest_filter_size(){
+	uint8_t x_size = x_axis.suggest_filter_size();
+	uint8_t y_size = y_axis.suggest_filter_size();
+	if(x_size == 0 || y_size == 0) return 0;
+	return x_size > y_size ? x_size : y_size;
+}
+void Gimbal::set_paired_requests(uint8_t state) {paired = state;}
+uint8_t Gimbal::is_paired() {return paired;}
 void Gimbal::send_adc_requests(Adc *adc)
 {
+	if(paired) {
+		adc->add_group_request(&pair);	// Refused while the previous pair is still pending
+		return;
+	}
 	x_axis.send_adc_request(adc);
 	y_axis.send_adc_request(adc);
 }
+// Stages of an axis handled by the Gimbal in radial mode : bypassed in the pipeline, returns their previous bypass states
+static uint8_t take_over_stages(Axis* axis){
+	const TransformElement::T_Elmt_Key keys[3] = {TransformElement::DZone, TransformElement::TrimH, TransformElement::Mod};
+	uint8_t bypass_mask = 0;
+	for(uint8_t i = 0; i < 3; i++) {
+		if(axis->is_bypassed(keys[i])) bypass_mask |= 1 << keys[i];
+		axis->set_bypass(keys[i], 1);
+	}
+	return bypass_mask;
+}
+static void give_back_stages(Axis* axis, uint8_t bypass_mask){
+	axis->set_bypass(TransformElement::DZone, (bypass_mask & SENSOR_BYPASS(DZone)) != 0);
+	axis->set_bypass(TransformElement::TrimH, (bypass_mask & SENSOR_BYPASS(TrimH)) != 0);
+	axis->set_bypass(TransformElement::Mod, (bypass_mask & SENSOR_BYPASS(Mod)) != 0);
+}
+// Trim and curve of an axis, applied to the output of the radial stage
+static int16_t finish_axis(Axis* axis, uint8_t bypass_mask, int16_t value){
+	if(!(bypass_mask & SENSOR_BYPASS(TrimH))) value = axis->get_trim_handler_ptr()->compute(value);
+	if(!(bypass_mask & SENSOR_BYPASS(Mod))) value = axis->get_modifier_ptr()->compute(value);
+	return value;
+}
+
+uint8_t Gimbal::set_radial_deadzone(int16_t radius, uint8_t enable){
+	if(!enable) {
+		if(radial_mode) {
+			give_back_stages(&x_axis, x_bypass);
+			give_back_stages(&y_axis, y_bypass);
+		}
+		radial_mode = 0;
+		return 1;
+	}
+	LinearSpace* x_space = x_axis.get_output_space_ptr();
+	LinearSpace* y_space = y_axis.get_output_space_ptr();
+	if(x_space->get_min() != y_space->get_min() || x_space->get_max() != y_space->get_max()) return 0;
+	int16_t low = x_space->get_min() < x_space->get_max() ? x_space->get_min() : x_space->get_max();
+	int16_t high = x_space->get_min() < x_space->get_max() ? x_space->get_max() : x_space->get_min();
+	if(!radial.set_ranges(low + (high - low) / 2, (high - low) / 2, radius)) return 0;
+	if(!radial_mode) {
+		x_bypass = take_over_stages(&x_axis);
+		y_bypass = take_over_stages(&y_axis);
+		// The pipelines hold no DataHandler output yet : current outputs are kept until the next sample
+		x_output = x_axis.read_sensor();
+		y_output = y_axis.read_sensor();
+	}
+	radial_mode = 1;
+	return 1;
+}
 void Gimbal::update_sensors(){
-	x_axis.update_result();
-	y_axis.update_result();
+	if(paired && !pair.take_completion()) return;	// No new pair
+	uint8_t x_processed = x_axis.update_result();
+	uint8_t y_processed = y_axis.update_result();
+	if(radial_mode && (x_processed || y_processed)) {
+		int16_t x = x_axis.read_sensor();	// DataHandler outputs
+		int16_t y = y_axis.read_sensor();
+		radial.compute(&x, &y);
+		x_output = finish_axis(&x_axis, x_bypass, x);
+		y_output = finish_axis(&y_axis, y_bypass, y);
+	}
 }
-const int16_t Gimbal::read_x_axis() {return x_axis.read_sensor();}
-const int16_t Gimbal::read_y_axis() {return y_axis.read_sensor();}
+const int16_t Gimbal::read_x_axis() {return radial_mode ? x_output : x_axis.read_sensor();}
+const int16_t Gimbal::read_y_axis() {return radial_mode ? y_output : y_axis.read_sensor();}
 	
 void Gimbal::set_adc_muxes(uint8_t x_mux, uint8_t y_mux){
 	x_axis.set_adc_mux(x_mux);
@@ -21,6 +21,25 @@ microcontroller.
 #include "adc_tools.h"
 #include "TransformPipeline.h"
 #include "S_PipeElement.h"
+#include "SampleRing.h"
+#include "ElementArena.h"
+#include "SensorConfig.h"
+
+// Build with -DSTATIC_TRANSFORM_PIPELINE to use the compile-time pipeline (see StaticPipeline.h) :
+// elements are called directly instead of through TransformElement* and the vtable.
+// Potentiometers leave the Deadzone and Modifier stages empty.
+// Build with -DSHARED_PIPELINE_TOPOLOGY to share the chain description between the sensors of a class (see SharedPipeline.h) :
+// each sensor only keeps its last values and first stale stage. STATIC_TRANSFORM_PIPELINE wins if both are given.
+#ifdef STATIC_TRANSFORM_PIPELINE
+#undef SHARED_PIPELINE_TOPOLOGY
+#include "StaticPipeline.h"
+typedef StaticPipeline<NoiseStats, DataFilter, Deadzone, DataHandler, TrimHandler, Modifier> SensorPipeline;
+#elif defined(SHARED_PIPELINE_TOPOLOGY)
+#include "SharedPipeline.h"
+typedef SharedPipeline SensorPipeline;
+#else
+typedef TransformPipeline SensorPipeline;
+#endif
 
 
 
@@ -52,12 +71,22 @@ class AnalogSensor : public HardwareActuator {            // inherits from Hardw
 	public:
 	   AnalogSensor();
 	   AnalogSensor(uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max,uint16_t result, uint16_t input, uint8_t hard_priority = 0, uint8_t phy_port = 0) ;
-	   void set_adc_result(uint16_t n_in); // Set input from the outside of the Analog class	   
-	   uint16_t get_adc_result();
-	   void update_result(); // Send a request to the transform pipeline. It calculates the overall result
+	   AnalogSensor(const SensorConfig* flash_config);	// Settings read from flash (see SensorConfig.h) : mux, ranges, filter bypass
+	   // Copies the settings and the element states. The copy uses its own DataFilter (a filter given to set_filter()
+	   // is not shared) and starts with an empty sample ring, no pending request and no pipeline (see the derived classes)
+	   AnalogSensor(const AnalogSensor& other);
+	   void set_adc_result(uint16_t n_in, uint16_t stamp = 0); // Set input from the outside of the Analog class (pushes a sample, called by the ISR)
+	   uint16_t get_adc_result();	// Last result written by the ISR
+	   uint8_t update_result(); // Drains the samples through the transform pipeline. Returns the number of processed samples
+	   uint16_t get_sample_stamp();	// Time stamp of the last processed sample (see ADC_TIMESTAMP in adc_tools.h)
+	   uint16_t get_lost_samples();	// Samples dropped because update_result() was called too late
 	   void set_ranges(uint16_t in_min,uint16_t in_max, uint16_t out_min, uint16_t out_max); // Initializes ranges (boundaries) of subranges input and output spaces of data_handler	   	   
 	   const int16_t read_sensor(); // Fetches and returns the result value (which could also be named : read_sensor())	   	   
-	   void calibrate(uint8_t state);	// Triggers calibration (switches ON calibration)
+	   // Calibration : while it is ON, update_result() tracks the min / max of the raw samples.
+	   // Switching it OFF maps the tracked span to the output space (DataHandler input space), if the sensor moved enough
+	   void calibrate(uint8_t state);
+	   uint16_t get_calibration_min();
+	   uint16_t get_calibration_max();
 	   
 	   uint8_t get_adc_mux();
        void set_adc_mux(uint8_t n_mux);
@@ -69,6 +98,24 @@ class AnalogSensor : public HardwareActuator {            // inherits from Hardw
 	   void init_pipeline();
 	   void set_bypass(TransformElement::T_Elmt_Key element, uint8_t byp);
 	   uint8_t is_bypassed(TransformElement::T_Elmt_Key element);
+	   // Replaces the built-in DataFilter by another filter element (MovingAverage<16>, EmaFilter<3>, IirFilter...), NULL restores it
+	   // Not available with the static pipeline (returns 0) : its filter type is fixed at compile time
+	   uint8_t set_filter(TransformElement* n_filter);
+	   // Extra stage of this sensor only, placement-constructed in an arena (median, statistics...) before the stage at position
+	   // (0 : on the raw samples). Returns NULL if the arena or the pipeline is full (an Axis needs PIPELINE_SIZE > 6),
+	   // and with the static or shared pipeline : their chains are the same for every sensor of a class
+	   template<typename Element> Element* add_stage(ElementArena* arena, uint8_t position)
+	   {
+#if defined(STATIC_TRANSFORM_PIPELINE) || defined(SHARED_PIPELINE_TOPOLOGY)
+		   (void) arena;
+		   (void) position;
+		   return NULL;
+#else
+		   return pipe.create_element<Element>(arena, position);
+#endif
+	   }
+	   // Removes a stage given by add_stage() and gives its block back to the arena, returns 0 if it isn't in the pipeline
+	   uint8_t remove_stage(TransformElement* stage, ElementArena* arena);
 	  
 	   LinearSpace* get_input_space_ptr(); // Linking Analog methods to the same ones of data_handler to get the input/output_space pointers
 	   LinearSpace* get_output_space_ptr();	   	  
@@ -78,12 +125,16 @@ class AnalogSensor : public HardwareActuator {            // inherits from Hardw
 	protected:
 	   DataHandler data_handler;
 	   DataFilter filter;
+	   TransformElement* active_filter;	// filter or the one given to set_filter()
 	   AdcHandler adc_handler;
 	   int16_t sensor_value;
-	   uint16_t adc_result;
+	   volatile uint16_t adc_result;
 	   uint8_t calibration_mode;
-	   TransformPipeline pipe;
-	   uint8_t conv_success;
+	   uint16_t calibration_min;	// Raw span seen since calibration started
+	   uint16_t calibration_max;
+	   SensorPipeline pipe;
+	   SampleRing samples;	// ISR -> main loop samples, in conversion order
+	   uint16_t sample_stamp;
 	   
    };
 
@@ -92,6 +143,8 @@ class Potentiometer : public AnalogSensor {
 	public:
 	Potentiometer();
 	Potentiometer(uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max,uint16_t result, uint16_t input, uint8_t hard_priority = 0, uint8_t phy_port = 0);
+	Potentiometer(const SensorConfig* flash_config);
+	Potentiometer(const Potentiometer& other);	// Pipeline rebuilt on the elements of the copy
 	};
 	
 class Axis : public AnalogSensor{
@@ -99,17 +152,35 @@ class Axis : public AnalogSensor{
 		Axis();
 		Axis(uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max,
 			 uint16_t result, uint16_t input, uint8_t hard_priority = 0, uint8_t phy_port = 0);
+		// Settings read from flash (see SensorConfig.h), deadzone and bypass mask included.
+		// The Modifier covers the output space (linear response until a curve is set, like Axis())
+		Axis(const SensorConfig* flash_config);
+		// Pipeline rebuilt on the elements of the copy (see AnalogSensor(const AnalogSensor&)), stages added with add_stage() are not copied
+		Axis(const Axis& other);
 		void set_deadzone(uint16_t min,uint16_t max,uint16_t init_neutral,uint8_t init_bypass);
+		// Same as AnalogSensor::calibrate(), switching it OFF also centres the deadzone on the current (rest) position
+		// of the stick, keeping its width, and sets its neutral value to the middle of the calibrated span
+		void calibrate(uint8_t state);
+		// Noise measurement, stick at rest : measure_noise(1) starts measuring the raw samples (NoiseStats), measure_noise(0) stops it.
+		// Once NOISE_STATS_SAMPLES samples have been measured, switching it OFF sizes the deadzone around the rest position
+		// (3 standard deviations of the input filtered by the active filter + 1 LSB), sets its neutral value to the rest position
+		// and bypasses the active filter when the noise is under 1 LSB. Returns 1 if the settings were changed
+		uint8_t measure_noise(uint8_t state);
+		// Window of the MovingAverage bringing the measured noise under 1/2 LSB (see NoiseStats), to give to set_filter().
+		// 0 until a measurement is complete
+		uint8_t suggest_filter_size();
 		void init_pipeline();
 		void set_bypass(TransformElement::T_Elmt_Key element, uint8_t byp);
 		uint8_t is_bypassed(TransformElement::T_Elmt_Key element);
 				
 		Deadzone* get_deadzone_ptr();
-		//TrimHandler* get_trim_handler_ptr();
-		//Modifier* get_modifier_ptr();
+		TrimHandler* get_trim_handler_ptr();	// Trim offset added to the mapped value (0 by default)
+		Modifier* get_modifier_ptr();	// Response curve (expo / rate), bypassed by default
+		NoiseStats* get_noise_stats_ptr();	// Raw input statistics, bypassed by default
 	private:
-		//Modifier modifier;
-		//TrimHandler trim;
+		NoiseStats noise_stats;
+		Modifier modifier;
+		TrimHandler trim;
 		Deadzone deadzone;
 	};
 
@@ -120,9 +191,23 @@ class Gimbal // Class containing the gimbal's attributes and stuff
     public:
         Gimbal();
         Gimbal(Axis &X_axis ,Axis &Y_axis );
-        void calibrate(uint8_t state); // Used for calibration purposes. Defines the
+		Gimbal(const GimbalConfig* flash_config);	// Both axes, paired requests and radial deadzone read from flash
+        void calibrate(uint8_t state); // Calibrates both axes at once : move the stick around its full travel, release it, switch OFF
+        uint8_t measure_noise(uint8_t state); // Measures the noise of both axes (sticks at rest), see Axis::measure_noise()
+		uint8_t suggest_filter_size();	// Largest of the two Axis::suggest_filter_size(), 0 until both are measured
+		// Joint X / Y processing : radial deadzone of radius "radius" (output units, before the curve) and circle to square
+		// mapping (see RadialDeadzone), in place of the square deadzones of the axes.
+		// The 2D stage needs both axes in one space, so it runs on the DataHandler outputs : the Deadzone, TrimHandler and
+		// Modifier of the axes are bypassed in their pipelines, and the Gimbal applies the trims and curves after it, once
+		// per update. Their bypass states are saved, change them after set_radial_deadzone(0, 0), which restores them.
+		// Both axes must have the same output space. The outputs are shaped from the next sample on
+		uint8_t set_radial_deadzone(int16_t radius, uint8_t enable = 1);
+		// Paired requests : X and Y are sent as one Adc group (Adc::add_group_request), converted back to back and
+		// delivered together. update_sensors() then only runs when a new pair has landed
+		void set_paired_requests(uint8_t state);
+		uint8_t is_paired();
 		void send_adc_requests(Adc *adc);
-		void update_sensors();
+		void update_sensors();	// Radial mode : shapes the latest X / Y pair when at least one of the axes got a new sample
 		const int16_t read_x_axis();
 		const int16_t read_y_axis();
 		
@@ -134,5 +219,15 @@ class Gimbal // Class containing the gimbal's attributes and stuff
         Axis x_axis;                          // X axis sensor properties
         Axis y_axis;                          // Y axis sensor properties
 
+	private:
+		RadialDeadzone radial;
+		uint8_t radial_mode;
+		int16_t x_output;	// Outputs of the radial stage
+		int16_t y_output;
+		uint8_t x_bypass;	// Saved bypass states of the stages taken over in radial mode (SENSOR_BYPASS() bits)
+		uint8_t y_bypass;
+		AdcGroup pair;	// X then Y
+		uint8_t paired;
+
     };
 #endif
\ No newline at end of file
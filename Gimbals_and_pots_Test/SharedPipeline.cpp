@@ -0,0 +1,99 @@
+#include "SharedPipeline.h"
+#include "Profiler.h"
+#include <stddef.h>
+#ifdef TAGGED_ELEMENT_DISPATCH
+#include "S_PipeElement.h"	// Dispatch switch, inlined in transform()
+#endif
+
+/************************************************************************/
+/* PipelineTopology implementation                                      */
+/************************************************************************/
+
+uint8_t PipelineTopology::add_offset(SharedPipeline* pipe, void* address, uint8_t stateful)
+{
+	int32_t offset = (int32_t)((uint8_t*) address - (uint8_t*) pipe);
+	if (stage_nb >= max_pipeline_size || offset < INT16_MIN || offset > INT16_MAX) return 0;
+	offsets[stage_nb] = (int16_t) offset;
+	if (stateful) stateful_mask |= 1 << stage_nb;
+	stage_nb++;
+	return 1;
+}
+
+uint8_t PipelineTopology::add_stage(SharedPipeline* pipe, TransformElement* element)
+{
+	if (element == NULL) return 0;
+	return add_offset(pipe, element, element->is_stateful());
+}
+
+uint8_t PipelineTopology::add_indirect_stage(SharedPipeline* pipe, TransformElement** element_ptr)
+{
+	if (element_ptr == NULL || *element_ptr == NULL) return 0;
+	if (!add_offset(pipe, element_ptr, (*element_ptr)->is_stateful())) return 0;
+	indirect_mask |= 1 << (stage_nb - 1);
+	return 1;
+}
+
+uint8_t PipelineTopology::is_built() {return stage_nb != 0;}
+uint8_t PipelineTopology::get_stage_nb() {return stage_nb;}
+uint8_t PipelineTopology::get_stateful_mask() {return stateful_mask;}
+
+/************************************************************************/
+/* SharedPipeline implementation                                        */
+/************************************************************************/
+
+SharedPipeline::SharedPipeline() : topology(NULL), first_stale(0)
+{
+	init_last_results();
+}
+
+void SharedPipeline::set_topology(PipelineTopology* n_topology)
+{
+	topology = n_topology;
+	attach_elements();
+}
+
+PipelineTopology* SharedPipeline::get_topology() {return topology;}
+
+void SharedPipeline::attach_elements()
+{
+	if (topology == NULL) return;
+	for (uint8_t i = 0; i < topology->get_stage_nb(); i++) topology->get_element(this, i)->attach(&first_stale, i);
+	first_stale = 0;	// Whole chain is recomputed next time
+}
+
+void SharedPipeline::init_last_results(int16_t init_value)
+{
+	for (uint8_t i = 0; i < max_pipeline_size + 1; i++) last_values[i] = init_value;
+	first_stale = 0;
+}
+
+// Same rules as TransformPipeline::transform() : stateful stages are always computed, a stateless stage fed with
+// the same input as before passes its cached output along, stages from the first stale one are recomputed
+int16_t SharedPipeline::transform(int16_t input)
+{
+	PROFILE_SCOPE(CycleProfiler::Transform);
+	if (topology == NULL) return input;
+	uint8_t stale = first_stale;
+	first_stale = no_stale_stage;	// Changes made from now on are seen by the next call
+	uint8_t stage_nb = topology->get_stage_nb();
+	uint8_t stateful_mask = topology->get_stateful_mask();
+	for (uint8_t i = 0; i < stage_nb; i++)
+	{
+		if (i < stale && last_values[i] == input && !(stateful_mask & (1 << i)))
+		{
+			if (stale == no_stale_stage && (stateful_mask >> i) == 0) return last_values[stage_nb];
+			input = last_values[i + 1];
+			continue;
+		}
+		last_values[i] = input;
+		TransformElement* element = topology->get_element(this, i);
+		if (!element->is_bypassed())
+		{
+			PROFILE_BEGIN(element_start);
+			input = element->compute(input);
+			PROFILE_END(CycleProfiler::FirstElement + element->get_type(), element_start);
+		}
+	}
+	last_values[stage_nb] = input;
+	return input;
+}
@@ -0,0 +1,62 @@
+/*
+Version |   date   |  description
+V 0.1   17/10/2026  Pipeline topology shared by the sensors of a class (flyweight), per sensor state only
+*/
+
+#ifndef SHARED_PIPELINE
+#define SHARED_PIPELINE
+
+#include <stdint.h>
+#include "TransformPipeline.h"
+
+class SharedPipeline;
+
+// Immutable description of a chain, shared by every sensor of a class : each stage is given by the offset of its
+// element from the pipeline, inside their common owner (e.g. Axis::deadzone from AnalogSensor::pipe). As all the
+// objects of a class have the same layout, the topology is described once from the first one.
+// Indirect stages are pointer members of the owner (e.g. AnalogSensor::active_filter, changed by set_filter()).
+// No constructor : topologies are static objects, zero initialized before any sensor constructor runs.
+class PipelineTopology
+{
+	public:
+		// Both return 0 if the topology is full, or if the element is too far from the pipeline
+		uint8_t add_stage(SharedPipeline* pipe, TransformElement* element);
+		uint8_t add_indirect_stage(SharedPipeline* pipe, TransformElement** element_ptr);
+		uint8_t is_built();
+		uint8_t get_stage_nb();
+		uint8_t get_stateful_mask();
+		inline TransformElement* get_element(SharedPipeline* pipe, uint8_t stage)
+		{
+			uint8_t* address = (uint8_t*) pipe + offsets[stage];
+			if (indirect_mask & (1 << stage)) return *(TransformElement**) address;
+			return (TransformElement*) address;
+		}
+	private:
+		uint8_t add_offset(SharedPipeline* pipe, void* address, uint8_t stateful);
+		int16_t offsets[max_pipeline_size];
+		uint8_t indirect_mask;	// bit i set : offsets[i] locates a TransformElement* member
+		uint8_t stateful_mask;	// bit i set : stage i is stateful (filters : stays true for the filters given to set_filter())
+		uint8_t stage_nb;
+};
+
+// Per sensor part of the pipeline : the last values of the stages and the first stale stage.
+// Same memoization as TransformPipeline::transform(), without the affine fusion (its plan would be per sensor state)
+class SharedPipeline
+{
+	public:
+		SharedPipeline();
+		// Binds the pipeline to its topology and attaches the elements of its owner (see attach_elements())
+		void set_topology(PipelineTopology* n_topology);
+		PipelineTopology* get_topology();
+		// Attaches the elements of the owner to the pipeline (notify_change()) and marks the whole chain stale.
+		// Call it after an indirect stage has been changed (AnalogSensor::set_filter()), no-op without topology
+		void attach_elements();
+		void init_last_results(int16_t init_value = 0);
+		int16_t transform(int16_t input);
+	private:
+		PipelineTopology* topology;
+		int16_t last_values[max_pipeline_size + 1];	// last_values[i] : last input of stage i, last one is the output
+		uint8_t first_stale;	// Written by the elements (notify_change()), no_stale_stage when up to date
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+Version |   date   |  description
+V 0.1   17/10/2026  Compile-time version of the TransformPipeline (no virtual dispatch)
+*/
+
+#ifndef STATIC_PIPELINE
+#define STATIC_PIPELINE
+
+#include <stdint.h>
+#include <stddef.h>
+#include "TransformPipeline.h"
+#include "Profiler.h"
+
+// Compile-time alternative to TransformPipeline.
+// The chain is described by its element types, e.g. StaticPipeline<DataFilter, Deadzone, DataHandler>.
+// Each stage knows the exact type of its element, so compute() is called directly (qualified call, inlined)
+// instead of going through the vtable, and there is no TransformElement* array to walk anymore.
+// The elements still carry their vptr (other users call them through TransformElement*) : build with
+// -DTAGGED_ELEMENT_DISPATCH as well to drop it.
+// Memoization is decided per stage, with the same rules as TransformPipeline::transform() : stages whose type
+// declares "stateful = 1" (e.g. DataFilter) are always computed, a stateless stage fed with the same input
+// as before passes its previous output along (known at compile time : the last input of the next stage),
+// and evaluation stops there when no stateful stage follows. Stages from the first stale one are recomputed.
+// Note : needs C++11 (variadic templates), i.e. -std=gnu++11 with avr-gcc
+
+// One stage of the chain : holds the typed element pointer and its last input,
+// then forwards the result to the next stage
+template<uint8_t Index, typename... Elements>
+class StaticStage
+{
+	public:
+		static const uint8_t has_stateful = 0;
+		void set_elements(uint8_t*) {}
+		void init_last_results(int16_t) {}
+		int16_t cached_input(int16_t last_output) {return last_output;}
+		int16_t run(int16_t input, uint8_t, int16_t) {return input;}	// End of the chain
+};
+
+template<uint8_t Index, typename Element, typename... Next>
+class StaticStage<Index, Element, Next...>
+{
+	typedef StaticStage<Index + 1, Next...> NextStage;
+	public:
+		StaticStage() : element(NULL), last_input(0) {}
+
+		// A stateful stage at this position or after it
+		static const uint8_t has_stateful = Element::stateful || NextStage::has_stateful;
+
+		// NULL elements are skipped (e.g. no Deadzone for Potentiometers)
+		void set_elements(uint8_t* stale_stage, Element* n_element, Next*... next_elements)
+		{
+			element = n_element;
+			if(element != NULL) element->attach(stale_stage, Index);
+			next.set_elements(stale_stage, next_elements...);
+		}
+
+		void init_last_results(int16_t init_value)
+		{
+			last_input = init_value;
+			next.init_last_results(init_value);
+		}
+
+		// Last output of the previous stage
+		int16_t cached_input(int16_t) {return last_input;}
+
+		inline int16_t run(int16_t input, uint8_t stale, int16_t last_output)
+		{
+			// Stateless stage fed with the same input as before : same output as last time
+			if(!Element::stateful && Index < stale && input == last_input) {
+				if(!NextStage::has_stateful && stale == no_stale_stage) return last_output;
+				return next.run(next.cached_input(last_output), stale, last_output);
+			}
+			last_input = input;
+			if(element != NULL && !element->is_bypassed()) {
+				PROFILE_BEGIN(element_start);
+				input = element->Element::compute(input);	// Qualified : no virtual call, even if compute() is virtual
+				PROFILE_END(CycleProfiler::FirstElement + element->get_type(), element_start);
+			}
+			return next.run(input, stale, last_output);
+		}
+
+	private:
+		Element* element;
+		int16_t last_input;
+		NextStage next;
+};
+
+template<typename... Elements>
+class StaticPipeline
+{
+	public:
+		StaticPipeline() : output(0), first_stale(0) {}
+
+		// Binds the elements of the chain (one pointer per type of the template list, in the same order)
+		void set_elements(Elements*... elements)
+		{
+			stages.set_elements(&first_stale, elements...);
+			first_stale = 0;
+		}
+
+		void init_last_results(int16_t init_value = 0)
+		{
+			stages.init_last_results(init_value);
+			output = init_value;
+			first_stale = 0;
+		}
+
+		// Same behavior as TransformPipeline::transform()
+		int16_t transform(int16_t input)
+		{
+			PROFILE_SCOPE(CycleProfiler::Transform);
+			uint8_t stale = first_stale;
+			first_stale = no_stale_stage;
+			output = stages.run(input, stale, output);
+			return output;
+		}
+
+	private:
+		StaticStage<0, Elements...> stages;
+		int16_t output;		// Last overall output (returned when memoization stops the evaluation)
+		uint8_t first_stale;	// Written by the elements (notify_change()), no_stale_stage when up to date
+};
+
+#endif
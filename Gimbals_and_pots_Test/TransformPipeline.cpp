@@ -1,32 +1,125 @@
 ﻿
 #include "TransformPipeline.h"
+#include "Profiler.h"
 #include <stddef.h>
+#ifdef TAGGED_ELEMENT_DISPATCH
+#include "S_PipeElement.h"	// Dispatch switch, inlined in transform()
+#endif
 
 /************************************************************************/
 /* TransformElement implementation                                      */
 /************************************************************************/
-TransformElement::TransformElement():bypass(0), changed_flag(1){}
-TransformElement::TransformElement(uint8_t init_bypass,T_Elmt_Key n_type) :type(n_type), bypass(init_bypass),changed_flag(1){}
-TransformElement::TransformElement(TransformElement::T_Elmt_Key n_type):bypass(0), changed_flag(1),type(n_type){}
+TransformElement::TransformElement():bypass(0), changed_flag(1), stale_stage(NULL), stage(0){}
+TransformElement::TransformElement(uint8_t init_bypass,T_Elmt_Key n_type) :type(n_type), bypass(init_bypass),changed_flag(1),
+stale_stage(NULL), stage(0){}
+TransformElement::TransformElement(TransformElement::T_Elmt_Key n_type):type(n_type), bypass(0), changed_flag(1),
+stale_stage(NULL), stage(0){}
 void TransformElement::set_bypass(uint8_t byp)
 {
-	if(byp != bypass) changed_flag = 1; // Stores if the object has changed
+	if(byp == bypass) return;
 	bypass = byp;
+	notify_change(); // Stores if the object has changed
 	}
-uint8_t TransformElement::is_bypassed(){return bypass;}
 uint8_t TransformElement::has_changed() {return changed_flag;}
 void TransformElement::clear_changed_flag() {changed_flag = 0;}
 void TransformElement::set_type(T_Elmt_Key element) {type = element;}
-TransformElement::T_Elmt_Key TransformElement::get_type(){return type;}
+TransformElement::T_Elmt_Key TransformElement::get_type(){
+#ifdef TAGGED_ELEMENT_DISPATCH
+	if(type == DExternal) return (T_Elmt_Key) static_cast<ExternalElement*>(this)->key;
+#endif
+	return type;
+}
+#ifndef TAGGED_ELEMENT_DISPATCH
+uint8_t TransformElement::is_stateful(){return 0;}
+uint8_t TransformElement::get_affine(AffineMap*){return 0;}
+uint16_t TransformElement::get_noise_gain(){return 256;}
+ExternalElement::ExternalElement(uint8_t init_bypass, T_Elmt_Key n_key) : TransformElement(init_bypass, n_key) {}
+#else
+// compute(), is_stateful(), get_affine() and get_noise_gain() switch on the type : see S_PipeElement.cpp
+ExternalElement::ExternalElement(uint8_t init_bypass, T_Elmt_Key n_key) : TransformElement(init_bypass, DExternal), key(n_key),
+	compute_fn(NULL), noise_gain_fn(NULL) {}
+#endif
+void TransformElement::notify_change()
+{
+	changed_flag = 1;
+	if(stale_stage != NULL && stage < *stale_stage) *stale_stage = stage;	// Pipeline resumes from the first stale stage
+}
+void TransformElement::attach(uint8_t* n_stale_stage, uint8_t n_stage)
+{
+	stale_stage = n_stale_stage;
+	stage = n_stage;
+}
 	
 //void TransformElement::compute(){}
 
+/************************************************************************/
+/* AffineMap implementation                                             */
+/************************************************************************/
+void AffineMap::set_identity(){
+	origin = 0;
+	scale = 1;
+	shift = 0;
+	negate = 0;
+	offset = 0;
+	in_min = -32768;
+	in_max = 32767;
+}
+uint8_t AffineMap::is_translation(){return scale == 1 && shift == 0 && !negate;}
+
+int16_t AffineMap::apply(int16_t x){
+	int32_t distance = (int32_t) x - origin;
+	uint8_t neg = negate;
+	if (distance < 0) {
+		distance = -distance;
+		neg = !neg;
+	}
+	int32_t result = (int32_t)(((uint32_t) distance * scale) >> shift);
+	if (neg) result = -result;
+	return (int16_t)(result + offset);
+}
+
+uint8_t AffineMap::compose(AffineMap* next_map){
+	if (next_map->is_translation()) {
+		// Outputs of this map must stay in the domain of the translation (no saturation)
+		int16_t low = apply(in_min);
+		int16_t high = apply(in_max);
+		if (low > high) {
+			int16_t swap = low;
+			low = high;
+			high = swap;
+		}
+		if (low < next_map->in_min || high > next_map->in_max) return 0;
+		int32_t n_offset = (int32_t) offset + next_map->offset - next_map->origin;
+		if (n_offset < -32768 || n_offset > 32767) return 0;
+		offset = (int16_t) n_offset;
+		return 1;
+	}
+	if (!is_translation()) return 0;	// Truncations of two scaling maps don't compose
+	// x -> x + translation, then next_map : next_map with its origin and domain moved back
+	int32_t translation = (int32_t) offset - origin;
+	int32_t low = (int32_t) next_map->in_min - translation;
+	int32_t high = (int32_t) next_map->in_max - translation;
+	if (low < in_min) low = in_min;
+	if (high > in_max) high = in_max;
+	int32_t n_origin = (int32_t) next_map->origin - translation;
+	if (low > high || n_origin < -32768 || n_origin > 32767) return 0;
+	origin = (int16_t) n_origin;
+	scale = next_map->scale;
+	shift = next_map->shift;
+	negate = next_map->negate;
+	offset = next_map->offset;
+	in_min = (int16_t) low;
+	in_max = (int16_t) high;
+	return 1;
+}
+
 /************************************************************************/
 /* TransformPipeline implementation                                    */
 /************************************************************************/
 
 // Initialize object
-TransformPipeline::TransformPipeline():iterator(0),tot_elements(0),force_calculation(1){
+TransformPipeline::TransformPipeline():iterator(0),tot_elements(0),first_stale(0),stateful_mask(0),
+fused_first(no_stale_stage),fused_last(0){
 	init_array();
 	init_last_results();
 }
@@ -45,19 +138,54 @@ void TransformPipeline::init_last_results(int16_t init_value){
 	{
 		last_values[i] = init_value;
 	}
+	first_stale = 0;	// Cached outputs are no longer valid
 }
 
-// Look for any changes inside the pointed TransformElement
-// If its changed_flag is up, then it will force the TransformPipeline object
-// to re-calculate all its members
-uint8_t TransformPipeline::pipeline_has_changed() {
-	uint8_t has_changed = 0;
+// Elements report their changes themselves (notify_change()) : no need to poll them on every sample.
+// Statefulness is a virtual call, so it is only asked here, when the chain is modified.
+void TransformPipeline::attach_elements() {
+	stateful_mask = 0;
 	for (int i = 0; i < tot_elements; i++) {
-		if (my_elements[i] != NULL && my_elements[i]->has_changed()) {
-			has_changed = 1; // Tracks if something has been modified (changed bypass mode, changed inner boundaries, etc)
-			my_elements[i]->clear_changed_flag();	//	Acknowledged the modified state
+		if (my_elements[i] == NULL) continue;
+		my_elements[i]->attach(&first_stale, i);
+		if (my_elements[i]->is_stateful()) stateful_mask |= 1 << i;
+	}
+	first_stale = 0;	// Whole chain is recomputed next time
+}
+
+// Stateless elements which aren't affine (Deadzone, Modifier...) and filters are fusion barriers.
+// Fusing a single stage wouldn't save anything : runs need two affine elements at least.
+void TransformPipeline::plan_fusion() {
+	AffineMap map;
+	AffineMap stage_map;
+	uint8_t run_first = 0;
+	uint8_t run_last = 0;
+	uint8_t run_length = 0;	// Affine elements in the run (bypassed ones are the identity and don't count)
+	map.set_identity();
+	fused_first = no_stale_stage;
+	for (uint8_t i = 0; i < tot_elements; i++) {
+		if (my_elements[i] == NULL || my_elements[i]->is_bypassed()) continue;
+		uint8_t affine = my_elements[i]->get_affine(&stage_map);
+		if (affine && map.compose(&stage_map)) {
+			if (run_length == 0) run_first = i;
+			run_last = i;
+			run_length++;
+			continue;
 		}
-	}return has_changed;
+		if (run_length >= 2) break;
+		// Barrier, or an affine element which can't join the run : starts a new one
+		run_length = 0;
+		map.set_identity();
+		if (affine && map.compose(&stage_map)) {
+			run_first = i;
+			run_last = i;
+			run_length = 1;
+		}
+	}
+	if (run_length < 2) return;
+	fused = map;
+	fused_first = run_first;
+	fused_last = run_last;
 }
 
 
@@ -75,11 +203,13 @@ void TransformPipeline::left_shift(int position){
 
 // removes one element in the array and fill the gap (left-shifting the array)
 void TransformPipeline::remove_element(int position){
-	if (position > tot_elements) return;
-	if (tot_elements - 1 != 0) left_shift(position);
-	my_elements[tot_elements] = NULL;
+	if (position < 0 || position >= tot_elements) return;
+	if (my_elements[position] != NULL) my_elements[position]->attach(NULL, 0);	// No longer reports to this pipeline
+	left_shift(position);
 	tot_elements--;
-	iterator--;
+	my_elements[tot_elements] = NULL;
+	iterator = tot_elements;
+	attach_elements();
 }
 
 // Adds an element into the Pipeline at the end of the stack 
@@ -88,35 +218,92 @@ const void TransformPipeline::add_element(TransformElement* element){
 	if (iterator >= max_pipeline_size) return;	// Discards request if array is full
 	my_elements[iterator] = element;
 	tot_elements++;
-	if (iterator + 1 < max_pipeline_size) iterator++;
-	force_calculation = 1;
+	iterator++;
+	attach_elements();
+}
+
+// Inserts an element before the one at position, the chain is fully recomputed next time
+uint8_t TransformPipeline::insert_element(TransformElement* element, uint8_t position){
+	if (element == NULL || tot_elements >= max_pipeline_size) return 0;
+	if (position > tot_elements) position = tot_elements;
+	for (int i = tot_elements; i > position; i--)
+	{
+		my_elements[i] = my_elements[i - 1];
+	}
+	my_elements[position] = element;
+	tot_elements++;
+	iterator = tot_elements;
+	attach_elements();
+	return 1;
+}
+
+int TransformPipeline::find_element(TransformElement* element){
+	for (int i = 0; i < tot_elements; i++)
+	{
+		if (my_elements[i] == element) return i;
+	}
+	return -1;
+}
+
+// Replaces an element in place (e.g. another filter), the chain is fully recomputed next time
+uint8_t TransformPipeline::replace_element(TransformElement* old_element, TransformElement* new_element){
+	if (new_element == NULL) return 0;
+	for (int i = 0; i < tot_elements; i++)
+	{
+		if (my_elements[i] == old_element)
+		{
+			old_element->attach(NULL, 0);
+			my_elements[i] = new_element;
+			attach_elements();
+			return 1;
+		}
+	}
+	return 0;
 }
 
 // Calculates the whole transformation
 // -> Puts in a sequence all compute methods
 // And computes them in a row (chaining them)
-// Note : bypassing elements is done internally in each element.
-// It might be justified to process this directly inside the Pipeline class instead of within the element
-// -> Saves time and processing power if it is done inside Pipeline (less calls - returns)
+// last_values[i] is the last input of stage i, hence the last output of stage i - 1 :
+// a stage which doesn't need to be computed passes its cached output along.
+// A fused run is computed (or skipped) as a whole : the last values of its inner stages aren't kept up to date,
+// so the run is recomputed from its first stage whenever the fusion is planned again.
 int16_t TransformPipeline::transform(int16_t input){
-	//volatile int16_t intermediate = 0;
-	int16_t intermediate = 0;
-	if (pipeline_has_changed()) force_calculation = 1;	// Force re-evaluation of the pipeline's chain
+	PROFILE_SCOPE(CycleProfiler::Transform);
+	uint8_t stale = first_stale;
+	first_stale = no_stale_stage;	// Changes made from now on are seen by the next call
+	if (stale != no_stale_stage)
+	{
+		if (fused_first < stale) stale = fused_first;
+		plan_fusion();
+		if (fused_first < stale) stale = fused_first;
+	}
 	for (uint8_t i = 0; i < tot_elements; i++)
 	{
-		if (my_elements[i] != NULL)
+		uint8_t inside_run = i > fused_first && i <= fused_last;	// Computed stage by stage : input out of the fused domain
+		if (i < stale && last_values[i] == input && !(stateful_mask & (1 << i)) && !inside_run)
+		{
+			// Same input and configuration as last time : nothing left to compute if no stateful or stale stage follows
+			if (stale == no_stale_stage && (stateful_mask >> i) == 0) return last_values[tot_elements];
+			if (i == fused_first) i = fused_last;
+			input = last_values[i + 1];
+			continue;
+		}
+		last_values[i] = input;	// stores the new input
+		if (i == fused_first && input >= fused.in_min && input <= fused.in_max)
+		{
+			PROFILE_BEGIN(fused_start);
+			input = fused.apply(input);
+			PROFILE_END(CycleProfiler::FusedRun, fused_start);
+			i = fused_last;
+		}
+		else if (my_elements[i] != NULL && !my_elements[i]->is_bypassed())
 		{
-			if (last_values[i] == input && !force_calculation && my_elements[i]->get_type() != TransformElement::DFilter ) return last_values[tot_elements]; // Compares to the old input value
-			else last_values[i] = input;	// stores the new input
-			if (my_elements[i]->is_bypassed()) intermediate = input;
-			else {
-				intermediate = my_elements[i]->compute(input);	// stores result in an intermediate value
-				input = intermediate; // then next input is the intermediate we've just calculated
-			}
-			if(i == tot_elements - 1) last_values[i + 1] = intermediate;
+			PROFILE_BEGIN(element_start);
+			input = my_elements[i]->compute(input);
+			PROFILE_END(CycleProfiler::FirstElement + my_elements[i]->get_type(), element_start);
 		}
-		else last_values[i + 1] = 0;	// If we hit NULL pointer, set result to 0
 	}
-	force_calculation = 0;	// Once the array have been re-evaluated from the beginning, switch off the force calculation flag
-	return intermediate;
+	last_values[tot_elements] = input;
+	return input;
 }
\ No newline at end of file
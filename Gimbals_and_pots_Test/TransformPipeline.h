@@ -10,29 +10,123 @@ V 0.2   06/12/2017  Minor corrections. Used with AnalogSensor_test -> successful
 
 #include <stdint-gcc.h>
 
-const uint8_t max_pipeline_size = 5;
+// Build with -DPIPELINE_SIZE=n to change the capacity of the pipelines (8 at most : stage masks are 8 bits wide),
+// e.g. to leave room for the stages drawn from an arena (see ElementArena.h)
+#ifndef PIPELINE_SIZE
+#define PIPELINE_SIZE 6
+#endif
+const uint8_t max_pipeline_size = PIPELINE_SIZE;
+const uint8_t no_stale_stage = 0xFF;	// Pipeline is up to date
+
+// Affine map, same fixed-point form as the DataHandler : y = offset +/- ((|x - origin| * scale) >> shift)
+// (minus when negate xor x < origin). Only exact for inputs in [in_min ; in_max].
+// A translation (scale = 1, shift = 0, negate = 0) is y = x - origin + offset.
+struct AffineMap
+{
+	int16_t origin;
+	uint32_t scale;
+	uint8_t shift;
+	uint8_t negate;
+	int16_t offset;
+	int16_t in_min;
+	int16_t in_max;
+
+	void set_identity();
+	uint8_t is_translation();
+	int16_t apply(int16_t x);
+	// Chains next_map after this map (exact composition only), returns 0 if it can't be done :
+	// two scaling maps, or outputs leaving the input domain of next_map
+	uint8_t compose(AffineMap* next_map);
+};
+
+// Build with -DTAGGED_ELEMENT_DISPATCH to drop the virtual functions of TransformElement : compute(), is_stateful(),
+// get_affine() and get_noise_gain() switch on the element type and call the concrete class directly (see S_PipeElement.h).
+// Elements carry no vptr anymore and avr-gcc doesn't copy any vtable to SRAM. The switch only knows the element classes
+// of the sensors (DataFilter, Deadzone, DataHandler, TrimHandler, Modifier, NoiseStats) : the other filters are
+// ExternalElements, dispatched through a pointer to their compute function.
+// compute() and the compute() of those classes are inlined in transform() : no call per stage. dispatch_bench : same host
+// ticks per Potentiometer sample as the virtual call, about 15 % more per Axis sample (bigger transform() loop).
 
 // TODO define the TransformElement as a PipelineElement
 class TransformElement
 {
 public:
-	enum T_Elmt_Key {DHandler,DFilter,DZone,Mod,TrimH};
+	enum T_Elmt_Key {DHandler,DFilter,DZone,Mod,TrimH,DMedian,DStats,DExternal};
 	TransformElement();
 	TransformElement(uint8_t init_bypass,T_Elmt_Key n_type);
 	TransformElement(T_Elmt_Key type);
 	void set_bypass(uint8_t byp);
-	uint8_t is_bypassed();
+	uint8_t is_bypassed() {return bypass;}	// Inline : called for every stage of every sample
+#ifdef TAGGED_ELEMENT_DISPATCH
+	inline int16_t compute(int16_t input);	// The switch, defined in S_PipeElement.h (it knows the element classes)
+#else
 	virtual int16_t compute(int16_t) = 0;
+#endif
 	uint8_t has_changed();
 	void clear_changed_flag();
 	void set_type(T_Elmt_Key element);
 	T_Elmt_Key get_type();
+#ifdef TAGGED_ELEMENT_DISPATCH
+	uint8_t is_stateful();
+	uint8_t get_affine(AffineMap* map);
+	uint16_t get_noise_gain();
+#else
+	virtual uint8_t is_stateful();	// Runtime version of "stateful", overridden by the filters
+	// Affine elements describe their current mapping (returns 0 when the element isn't affine, the default)
+	virtual uint8_t get_affine(AffineMap* map);
+	// Output variance over input variance for white noise, Q8 (256, the default : noise passes through unchanged).
+	// Overridden by the filters, used to size a deadzone over the filtered noise (Axis::measure_noise())
+	virtual uint16_t get_noise_gain();
+#endif
+	static const uint8_t stateful = 0;	// Stateful elements (output depends on past inputs) can't be skipped by memoization
+	// Configuration changed : raises changed_flag and marks the element's stage as stale in its pipeline.
+	// Setters call it themselves, call it after modifying an element through a pointer (e.g. get_input_space_ptr()).
+	void notify_change();
+	// Called by the pipeline : where to report changes (first stale stage of the pipeline) and the element's position
+	void attach(uint8_t* n_stale_stage, uint8_t n_stage);
 protected:
 	T_Elmt_Key type;
 	uint8_t bypass;
 	uint8_t changed_flag;
+	uint8_t* stale_stage;
+	uint8_t stage;
+};
+
+// Base of the filters other than the DataFilter (MovingAverage, EmaFilter, MedianFilter, IirFilter), unknown to the dispatch
+// switch of -DTAGGED_ELEMENT_DISPATCH : there their type is DExternal, key keeps the one they give (get_type() returns it
+// in both builds) and compute() / get_noise_gain() go through compute_fn and noise_gain_fn, given by attach_compute()
+class ExternalElement : public TransformElement
+{
+public:
+	ExternalElement(uint8_t init_bypass, T_Elmt_Key n_key);
+#ifdef TAGGED_ELEMENT_DISPATCH
+	uint8_t key;
+	int16_t (*compute_fn)(TransformElement* element, int16_t input);
+	uint16_t (*noise_gain_fn)(TransformElement* element);
+#endif
 };
 
+#ifdef TAGGED_ELEMENT_DISPATCH
+template<typename Element> int16_t external_compute(TransformElement* element, int16_t input)
+{
+	return static_cast<Element*>(element)->compute(input);
+}
+template<typename Element> uint16_t external_noise_gain(TransformElement* element)
+{
+	return static_cast<Element*>(element)->get_noise_gain();
+}
+template<typename Element> inline void attach_compute(TransformElement*) {}
+template<typename Element> inline void attach_compute(ExternalElement* element)
+{
+	element->compute_fn = &external_compute<Element>;
+	element->noise_gain_fn = &external_noise_gain<Element>;
+}
+#else
+template<typename Element> inline void attach_compute(TransformElement*) {}
+#endif
+
+class ElementArena;
+
 class TransformPipeline
 {
 	// Here is the "pipeline" used.
@@ -46,7 +140,6 @@ class TransformPipeline
 		// First init the array with NULL pointers
 		void init_array();
 		void init_last_results(int16_t init_value = 0);
-		uint8_t pipeline_has_changed();
 		// Function used when removing an element in the Pipeline
 		// when removing an element at the i-th position
 		// shifts all elements whose position is above i to the previous one
@@ -55,16 +148,34 @@ class TransformPipeline
 		// removes one element in the array
 		void remove_element(int position);
 		// Adds an element into the Pipeline
-		const void add_element(TransformElement* element);
+		const void add_element(TransformElement* element);
+		// Swaps one element of the pipeline for another one (same position), returns 0 if old_element isn't in the pipeline
+		uint8_t replace_element(TransformElement* old_element, TransformElement* new_element);
+		// Inserts an element before the one at position (appends it if position is past the end), returns 0 if the pipeline is full
+		uint8_t insert_element(TransformElement* element, uint8_t position);
+		// Position of an element in the pipeline, -1 if it isn't there
+		int find_element(TransformElement* element);
+		// Elements placement-constructed in an arena (defined in ElementArena.h) : returns NULL if the arena or the pipeline is full
+		template<typename Element> Element* create_element(ElementArena* arena, uint8_t position);
+		// Removes an element and gives its block back to the arena, returns 0 if it isn't in the pipeline
+		uint8_t destroy_element(TransformElement* element, ElementArena* arena);
 
 		// Calculates the whole transformation
 		// -> Puts in a sequence all compute methods
 		// And computes them in a row (chaining them)
-		// Note : bypassing elements is done internally in each element.
-		// It might be justified to process this directly inside the Pipeline class instead of within the element
-		// -> Saves time and processing power if it is done inside Pipeline (less calls - returns)
+		// Stages are only computed when they have to :
+		//  -> stateful stages (filters) are computed for every sample
+		//  -> a stateless stage fed with the same input as before gives its previous output (last_values[i + 1]),
+		//     evaluation stops there when no stateful stage follows
+		//  -> stages from the first stale one (changed configuration, see notify_change()) are recomputed
+		//  -> a run of adjacent affine stages (e.g. DataHandler + TrimHandler, bypassed stages being the identity)
+		//     is computed as a single multiply-add, planned again after each configuration change
 		int16_t transform(int16_t input);
 	private:
+		// Looks for the first run of at least two affine stages which can be fused
+		void plan_fusion();
+		// Gives each element its position and the address of first_stale, updates stateful_mask
+		void attach_elements();
 		TransformElement* my_elements[max_pipeline_size];
 		int16_t last_values[max_pipeline_size + 1]; 
 		// Stores the (n-1) values for each elements
@@ -75,7 +186,11 @@ class TransformPipeline
 		// It will be used to stop computation if new results = last results.
 		int iterator;
 		int tot_elements;
-		uint8_t force_calculation;
+		uint8_t first_stale;	// Written by the elements (notify_change()), no_stale_stage when up to date
+		uint8_t stateful_mask;	// bit i set : stage i is stateful
+		AffineMap fused;	// Stages fused_first to fused_last in one operation
+		uint8_t fused_first;	// no_stale_stage if there is no fused run
+		uint8_t fused_last;
 };
 
 #endif
\ No newline at end of file
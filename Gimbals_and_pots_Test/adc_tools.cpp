@@ -1,18 +1,30 @@
 ﻿
 #include "adc_tools.h"
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "Sensors.h"
+#include "SensorBank.h"
+#include "Profiler.h"
 #include <stdint.h>
 #include <stddef.h> // NULL pointer needs it
 
 const uint8_t max_Sensor_Requests = 4;
 
 
-Adc::Adc():req_iterator(0),processing_iterator(0),tot_req(0),req_full_flag(0)
+#ifdef ADC_PENDING_BITMAP
+Adc::Adc():scan_nb(0),scan_current(0),scan_pending(0),scan_mode(0),oversampling_sum(0),oversampling_count(0),conversion_nb(0),bank(NULL),bank_current(0),
+group_head(0),group_count(0),group(NULL),group_current(0)
+#else
+Adc::Adc():req_iterator(0),processing_iterator(0),tot_req(0),req_full_flag(0),
+scan_nb(0),scan_current(0),scan_pending(0),scan_mode(0),oversampling_sum(0),oversampling_count(0),conversion_nb(0),bank(NULL),bank_current(0),
+group_head(0),group_count(0),group(NULL),group_current(0)
+#endif
 {
 	purge_requests(); // Initializing the requests table to NULL
+	clear_scan_list();
 }
 
+#ifndef ADC_PENDING_BITMAP
 void Adc::purge_requests()
 {
 	for(int i=0;i<ADC_REQUEST_SIZE;i++)
@@ -24,7 +36,7 @@ void Adc::purge_requests()
 
 uint8_t Adc::add_request(AnalogSensor *sensor)
 {
-	if(req_full_flag == 0){	// if pending requests array is not full
+	if(req_full_flag == 0 && scan_mode == 0 && bank == NULL){	// if pending requests array is not full (and the adc is not scanning)
 		requests[req_iterator] = sensor; // Add sensor's adress in pending request array
 		req_iterator = (req_iterator + 1) % ADC_REQUEST_SIZE ; // increments the request iterator (next request)
 		if(tot_req == 0 && (ADCSRA & 1<<ADSC)==0) start_conversion(); // if adc is idle (no requests), start a conversion
@@ -37,6 +49,7 @@ uint8_t Adc::add_request(AnalogSensor *sensor)
 
 // Starts an Adc conversion (updates registers, set AdcMux channel and trigger conversion)
 void Adc::start_conversion(){
+	PROFILE_SCOPE(CycleProfiler::AdcStart);
 	AnalogSensor *sensor = requests[processing_iterator];	// Fetches the currently evaluated sensor
 	while(sensor == NULL)
 	{ processing_iterator = (processing_iterator + 1) % ADC_REQUEST_SIZE;
@@ -48,14 +61,27 @@ void Adc::start_conversion(){
 		ADCSRA |= (1<<ADSC);	// start conversion
 	}
 }
+#endif
 
 // Switches on the Adc (wakes it up!)
 void Adc::initialize()
 {
 	purge_requests();	// Purges Adc pending requests array
+#ifndef ADC_PENDING_BITMAP
 	req_iterator = 0;	// starts with the first iterator
 	req_full_flag = 0;
 	tot_req = 0;
+#endif
+	scan_mode = 0;
+	bank = NULL;
+	for(; group_count; group_count--) {	// Queued and running groups are dropped
+		group_queue[group_head]->release();
+		group_head = (group_head + 1) % ADC_GROUP_QUEUE;
+	}
+	if(group != NULL) group->release();
+	group = NULL;
+	oversampling_sum = 0;
+	oversampling_count = 0;
 	ADCSRA = (1<<ADEN) | (1<<ADIE) | (1<<ADPS2) | (1<<ADPS1) | (1<<ADPS0);
 	// ADEN : ADC Enable Bit      // ADIE : ADC Interrupt Enable       // ADPS2:0 = 1 => Using 128 prescaller -> 16MHz baseclock / 128 = 125 kHz (inside 50 kHz - 200 kHz -> full resolution)
 	ADMUX |= 1<<REFS0;            // AVcc = Vcc reference (connected internally via high impedance resistors)
@@ -68,6 +94,7 @@ Adc* Adc::getPointer(void)
 	return this;
 }
 
+#ifndef ADC_PENDING_BITMAP
 // Decreases total pending request number
 void Adc::conversion_complete()
 {
@@ -75,15 +102,228 @@ void Adc::conversion_complete()
 	tot_req--;
 	if(tot_req <= ADC_REQ_LATCH) req_full_flag=0;
 	processing_iterator = (processing_iterator + 1) % (ADC_REQUEST_SIZE) ;
-	// Now it's time to handle the next conversion
-	if(tot_req > 0) start_conversion();
+	// Now it's time to handle the next conversion (queued groups first)
+	if(group_count) start_group();
+	else if(tot_req > 0) start_conversion();
 }
 
 // Extracts the pointer of the currently evaluated sensor
 AnalogSensor* Adc::get_current_sensor_id(){
+	if(scan_mode) return scan_list[scan_current];
+	if(group != NULL) return group->get_sensor(group_current);
 	return requests[processing_iterator];
 }
 
+// Returns the number of pending requests (used to monitor the queue occupancy)
+uint8_t Adc::get_pending_req_nb() {return tot_req;}
+uint8_t Adc::is_full() {return req_full_flag;}
+#endif
+
+// Handles the end of a conversion. Meant to be called from the ADC_vect ISR :
+// reads back the result, pushes it into the sensor which has sent the request
+// and then triggers the next pending conversion (if any)
+void Adc::handle_conversion()
+{
+	PROFILE_SCOPE(CycleProfiler::AdcIsr);
+	conversion_nb++;
+	if(scan_mode) {
+		handle_scan_conversion();
+		return;
+	}
+	if(bank != NULL) {
+		handle_bank_conversion();
+		return;
+	}
+	if(group != NULL) {
+		handle_group_conversion();
+		return;
+	}
+	AnalogSensor* mysensor = get_current_sensor_id();  // retrieves the sensor thanks to its adress stored inside the pending request list
+	if(mysensor != NULL){
+		volatile uint16_t adc_result;
+		adc_result = ADCL;
+		adc_result |= (ADCH<<8);
+		// Pushing left 8 times ADCH (x x x x x x ADC9 ADC8)(8 bits) -> (x x x x x x ADC9 ADC8 x x x x x x x x) (16 bits)
+		// ADCH<<8 | ADCL => (x x x x x x ADC9 ADC8 ADC7 ADC6 ADC5 ADC4 ADC3 ADC2 ADC1 ADC0);
+		// Note : Cannot write (ADCH<<8) | ADCL  => Those registers cannot be accessed all at once!
+		uint8_t oversampling = mysensor->get_adc_handler_ptr()->get_oversampling();
+		if(oversampling) {
+			// Accumulates 4^n conversions : ADMUX is left untouched, the next conversion is started right away
+			oversampling_sum += adc_result;
+			if(++oversampling_count < ((uint8_t)1 << (2 * oversampling))) {
+				ADCSRA |= (1<<ADSC);
+				return;
+			}
+			adc_result = oversampling_sum >> oversampling;	// Decimation : 10 + n bits result
+			oversampling_sum = 0;
+			oversampling_count = 0;
+		}
+		mysensor->set_adc_result(adc_result, ADC_TIMESTAMP);  // pushing back the result into the Sensor
+		mysensor->get_adc_handler_ptr()->conversion_complete();  // sends a signal to my sensor class. Handles all internal stuff related to Adc conversion (decrementing total request variable, and so on)
+		conversion_complete();    // Does everything related with the end of conversion (handling counters)
+	}
+	else {
+		oversampling_sum = 0;	// Cancelled request : partial accumulation is dropped
+		oversampling_count = 0;
+#ifdef ADC_PENDING_BITMAP
+		conversion_complete();	// the next channel is converted
+#endif
+	}
+}
+
+// Adds a sensor to the scan list (it will be sampled on its own adc mux)
+uint8_t Adc::add_scan_sensor(AnalogSensor *sensor)
+{
+	if(sensor == NULL || scan_nb >= ADC_SCAN_SIZE || scan_mode) return 0;
+	scan_list[scan_nb++] = sensor;
+	sensor->get_adc_handler_ptr()->set_scan_mode(1);
+	return 1;
+}
+
+void Adc::clear_scan_list()
+{
+	for(uint8_t i=0; i<ADC_SCAN_SIZE; i++)
+	{
+		if(i < scan_nb && scan_list[i] != NULL) scan_list[i]->get_adc_handler_ptr()->set_scan_mode(0);
+		scan_list[i] = NULL;
+	}
+	scan_nb = 0;
+}
+
+// Switches the adc to free running mode (ADATE with ADTS2:0 = 0)
+// Note : pending requests are not processed while scanning. Call after initialize().
+void Adc::start_scan()
+{
+	if(scan_nb == 0) return;
+	scan_current = 0;
+	scan_pending = 0;
+	scan_mode = 1;
+	ADMUX = (ADMUX & (0b11110000)) | scan_list[0]->get_adc_mux();	// First channel is selected before starting
+	ADCSRB &= ~((1<<ADTS2) | (1<<ADTS1) | (1<<ADTS0));	// Free running mode
+	ADCSRA |= (1<<ADATE) | (1<<ADSC);
+}
+
+// Stops auto triggering. The running conversion completes and is discarded.
+void Adc::stop_scan()
+{
+	ADCSRA &= ~(1<<ADATE);
+	scan_mode = 0;
+}
+
+uint8_t Adc::is_scanning() {return scan_mode;}
+
+// Starts converting the sensors of a bank, from the first one to the last one
+uint8_t Adc::start_bank_round(SensorBank *n_bank)
+{
+	if(n_bank == NULL || n_bank->get_sensor_nb() == 0) return 0;
+	if(bank != NULL || scan_mode || get_pending_req_nb() || group != NULL || group_count) return 0;	// Adc is busy
+	bank_current = 0;
+	bank = n_bank;
+	ADMUX = (ADMUX & (0b11110000)) | n_bank->get_mux(0);
+	ADCSRA |= (1<<ADSC);	// start conversion
+	return 1;
+}
+
+uint8_t Adc::is_bank_running() {return bank != NULL;}
+
+// Bank round ISR body : stores the sample and starts the next channel right away
+void Adc::handle_bank_conversion()
+{
+	uint16_t adc_result;
+	adc_result = ADCL;
+	adc_result |= (ADCH<<8);
+	bank->set_sample(bank_current, adc_result);
+	bank_current++;
+	if(bank_current < bank->get_sensor_nb()) {
+		ADMUX = (ADMUX & (0b11110000)) | bank->get_mux(bank_current);
+		ADCSRA |= (1<<ADSC);
+	}
+	else {
+		bank->round_complete(ADC_TIMESTAMP);
+		bank = NULL;
+	}
+}
+
+// Queues a group. Started right away if the Adc is idle, otherwise when the running conversion ends
+uint8_t Adc::add_group_request(AdcGroup *n_group)
+{
+	if(n_group == NULL || n_group->get_sensor_nb() == 0) return 0;
+	if(scan_mode || bank != NULL) return 0;
+	uint8_t sreg = SREG;
+	cli();
+	if(n_group->is_pending() || group_count >= ADC_GROUP_QUEUE) {
+		SREG = sreg;
+		return 0;
+	}
+	n_group->set_pending();
+	group_queue[(group_head + group_count) % ADC_GROUP_QUEUE] = n_group;
+	group_count++;
+#ifdef ADC_PENDING_BITMAP
+	if(!converting) start_group();	// (converting is also set while a group runs)
+#else
+	if(group == NULL && tot_req == 0 && (ADCSRA & 1<<ADSC)==0) start_group();
+#endif
+	SREG = sreg;
+	return 1;
+}
+
+uint8_t Adc::is_group_running() {return group != NULL;}
+
+void Adc::start_group()
+{
+	group = group_queue[group_head];
+	group_head = (group_head + 1) % ADC_GROUP_QUEUE;
+	group_count--;
+	group_current = 0;
+#ifdef ADC_PENDING_BITMAP
+	converting = 1;	// add_request() doesn't start anything until the group is over
+#endif
+	ADMUX = (ADMUX & (0b11110000)) | group->get_sensor(0)->get_adc_mux();
+	ADCSRA |= (1<<ADSC);	// start conversion
+}
+
+// Group ISR body : keeps the sample and starts the next channel right away. The last conversion delivers the
+// whole group, then the pending requests (or the next queued group) take over
+void Adc::handle_group_conversion()
+{
+	uint16_t adc_result;
+	adc_result = ADCL;
+	adc_result |= (ADCH<<8);
+	group->set_sample(group_current, adc_result);
+	group_current++;
+	if(group_current < group->get_sensor_nb()) {
+		ADMUX = (ADMUX & (0b11110000)) | group->get_sensor(group_current)->get_adc_mux();
+		ADCSRA |= (1<<ADSC);
+		return;
+	}
+	group->deliver(ADC_TIMESTAMP);
+	group = NULL;
+	// A pending request gets the next slot : groups sent again and again can't starve the requests
+#ifdef ADC_PENDING_BITMAP
+	start_conversion();	// Clears converting if no channel is pending
+	if(!converting && group_count) start_group();
+#else
+	if(tot_req > 0) start_conversion();
+	else if(group_count) start_group();
+#endif
+}
+
+// Scan mode ISR body.
+// In free running mode the next conversion has already started (with the mux which was in ADMUX)
+// when this ISR runs, so the mux written here is used by the conversion after the next one.
+void Adc::handle_scan_conversion()
+{
+	uint16_t adc_result;
+	adc_result = ADCL;
+	adc_result |= (ADCH<<8);
+	scan_list[scan_current]->set_adc_result(adc_result, ADC_TIMESTAMP);
+	scan_current = scan_pending;	// Conversion which has just started
+	scan_pending++;
+	if(scan_pending >= scan_nb) scan_pending = 0;
+	ADMUX = (ADMUX & (0b11110000)) | scan_list[scan_pending]->get_adc_mux();
+}
+
+#ifndef ADC_PENDING_BITMAP
 // Clears all requests of one AnalogSensor
 uint8_t Adc::clear_sensor_requests(AnalogSensor* sensor)
 {
@@ -99,15 +339,171 @@ uint8_t Adc::clear_sensor_requests(AnalogSensor* sensor)
 	return requests_removed;
 }
 
+#else
+/************************************************************************/
+/* Pending bitmap implementation of the requests list                   */
+/************************************************************************/
+// Shared with the ISR : main loop accesses are done with interrupts disabled
+
+void Adc::purge_requests()
+{
+	for(uint8_t i=0; i<ADC_CHANNEL_NB; i++)
+	{
+		channel_owner[i] = NULL;
+#ifdef ADC_PRIORITY_SCHEDULER
+		channel_weight[i] = 1;
+		channel_credit[i] = 0;
+#else
+		channel_fifo[i] = 0;
+#endif
+	}
+	pending_bitmap = 0;
+#ifndef ADC_PRIORITY_SCHEDULER
+	queued_bitmap = 0;
+	fifo_head = 0;
+	fifo_count = 0;
+#endif
+	current_sensor = NULL;
+	converting = 0;
+	tot_req = 0;
+}
+
+// Queues a request on the sensor's channel. Returns 0 if this channel is already pending
+uint8_t Adc::add_request(AnalogSensor *sensor)
+{
+	if(scan_mode || bank != NULL) return 0;
+	uint8_t channel = sensor->get_adc_mux() & (ADC_CHANNEL_NB - 1);
+	uint16_t channel_bit = (uint16_t) 1 << channel;
+	uint8_t sreg = SREG;
+	cli();
+	if(pending_bitmap & channel_bit) {
+		SREG = sreg;
+		return 0;	// One request per channel : duplicates are discarded
+	}
+	pending_bitmap |= channel_bit;
+	channel_owner[channel] = sensor;
+#ifdef ADC_PRIORITY_SCHEDULER
+	uint8_t priority = sensor->get_priority();
+	channel_weight[channel] = priority < ADC_MAX_WEIGHT ? priority + 1 : ADC_MAX_WEIGHT;
+#else
+	if(!(queued_bitmap & channel_bit)) {	// A cancelled entry may still sit in the fifo : it is reused
+		channel_fifo[(fifo_head + fifo_count) % ADC_CHANNEL_NB] = channel;
+		fifo_count++;
+		queued_bitmap |= channel_bit;
+	}
+#endif
+	tot_req++;
+	if(!converting) start_conversion();	// if adc is idle, start a conversion
+	SREG = sreg;
+	return 1;
+}
+
+#ifdef ADC_PRIORITY_SCHEDULER
+// Smooth weighted round-robin : every pending channel earns its weight, the richest one is converted
+// and pays back the weights total. Credits of idle channels are kept (a fast requester can't reset its debt)
+int8_t Adc::next_channel()
+{
+	int8_t best = -1;
+	int16_t total = 0;
+	uint16_t bits = pending_bitmap;
+	for(uint8_t channel = 0; bits; channel++, bits >>= 1)
+	{
+		if(!(bits & 1)) continue;
+		channel_credit[channel] += channel_weight[channel];
+		total += channel_weight[channel];
+		if(best < 0 || channel_credit[channel] > channel_credit[best]) best = channel;
+	}
+	if(best >= 0) channel_credit[best] -= total;
+	return best;
+}
+#else
+// Pops the oldest pending channel (cancelled entries are dropped on the way)
+int8_t Adc::next_channel()
+{
+	while(fifo_count)
+	{
+		uint8_t channel = channel_fifo[fifo_head];
+		uint16_t channel_bit = (uint16_t) 1 << channel;
+		fifo_head = (fifo_head + 1) % ADC_CHANNEL_NB;
+		fifo_count--;
+		queued_bitmap &= ~channel_bit;
+		if(pending_bitmap & channel_bit) return channel;
+	}
+	return -1;
+}
+#endif
+
+void Adc::start_conversion()
+{
+	PROFILE_SCOPE(CycleProfiler::AdcStart);
+	int8_t channel = next_channel();
+	if(channel < 0) {
+		converting = 0;
+		return;
+	}
+	pending_bitmap &= ~((uint16_t) 1 << channel);	// New requests on this channel are queued again during the conversion
+	current_sensor = channel_owner[channel];
+	converting = 1;
+	ADMUX = (ADMUX & (0b11110000)) | channel;	// Select conversion channel
+	ADCSRA |= (1<<ADSC);	// start conversion
+}
+
+// Called by the ISR : ends the running request and starts the next one
+void Adc::conversion_complete()
+{
+	if(current_sensor != NULL) tot_req--;
+	current_sensor = NULL;
+	converting = 0;
+	if(group_count) start_group();	// Queued groups go first
+	else start_conversion();
+}
+
+AnalogSensor* Adc::get_current_sensor_id(){
+	if(scan_mode) return scan_list[scan_current];
+	if(group != NULL) return group->get_sensor(group_current);
+	return current_sensor;
+}
+
+uint8_t Adc::get_pending_req_nb() {return tot_req;}
+uint8_t Adc::is_full() {return 0;}	// One pending slot per channel : never full
+
+// Cancels the pending request (and the running conversion) of one sensor in O(1)
+// Note : the sensor's mux must not have been changed since the request has been sent
+uint8_t Adc::clear_sensor_requests(AnalogSensor* sensor)
+{
+	uint8_t requests_removed = 0;
+	uint8_t channel = sensor->get_adc_mux() & (ADC_CHANNEL_NB - 1);
+	uint16_t channel_bit = (uint16_t) 1 << channel;
+	uint8_t sreg = SREG;
+	cli();
+	if((pending_bitmap & channel_bit) && channel_owner[channel] == sensor)
+	{
+		pending_bitmap &= ~channel_bit;	// Fifo entry (if any) stays and is skipped when popped
+		requests_removed++;
+	}
+	if(converting && current_sensor == sensor)
+	{
+		current_sensor = NULL;	// Result of the running conversion will be dropped
+		requests_removed++;
+	}
+	tot_req -= requests_removed;
+	SREG = sreg;
+	return requests_removed;
+}
+#endif
+
 
 AdcHandler::AdcHandler() : adc_mux(0), tot_request_nb(0),
-max_request_nb(max_Sensor_Requests), full_flag(0){}
+max_request_nb(max_Sensor_Requests), full_flag(0), scan_mode(0), oversampling(0){}
 
 AdcHandler::AdcHandler(uint8_t n_mux, uint8_t max_req) : adc_mux(n_mux), max_request_nb(max_req),
-tot_request_nb(0),full_flag(0){}
+tot_request_nb(0),full_flag(0),scan_mode(0),oversampling(0){}
+
+AdcHandler::AdcHandler(const AdcHandler& other) : adc_mux(other.adc_mux), tot_request_nb(0), max_request_nb(other.max_request_nb),
+full_flag(0), scan_mode(0), oversampling(other.oversampling){}
 // Adds an adc_request and send it to the Adc
 void AdcHandler::send_adc_request(Adc* adc,AnalogSensor* sensor){
-	if(full_flag) return;	// If we hit max_adc_req_nb earlier, discard new adc_request
+	if(full_flag || scan_mode) return;	// If we hit max_adc_req_nb earlier (or if the sensor is scanned), discard new adc_request
 	if(adc->add_request(sensor)) tot_request_nb++;	// if request has been added correctly, increment tot_request_nb
 	if(tot_request_nb >= max_request_nb) full_flag++; // Discard future adc_requests if we hit the max req nb for this sensor
 }
@@ -127,6 +523,10 @@ volatile uint8_t AdcHandler::get_max_req_nb() {return max_request_nb;}
 volatile uint8_t AdcHandler::get_tot_req_nb() {return tot_request_nb;}
 volatile uint8_t AdcHandler::is_full() {return full_flag;}
 volatile uint8_t AdcHandler::get_mux() {return adc_mux;}
+void AdcHandler::set_scan_mode(uint8_t state) {scan_mode = state;}
+uint8_t AdcHandler::is_scanned() {return scan_mode;}
+void AdcHandler::set_oversampling(uint8_t n) {oversampling = n < ADC_MAX_OVERSAMPLING ? n : ADC_MAX_OVERSAMPLING;}
+uint8_t AdcHandler::get_oversampling() {return oversampling;}
 
 void AdcHandler::clear_adc_req(Adc* adc, AnalogSensor* sensor)
 {
@@ -134,7 +534,58 @@ void AdcHandler::clear_adc_req(Adc* adc, AnalogSensor* sensor)
 	removed_requests = adc->clear_sensor_requests(sensor);
 	if(removed_requests)
 	{
-		tot_request_nb = 0;
-		full_flag = 0;
+		// Only the removed requests are forgotten (the other ones are still running)
+		tot_request_nb = removed_requests < tot_request_nb ? tot_request_nb - removed_requests : 0;
+		if(tot_request_nb < max_request_nb) full_flag = 0;
 	}
-}
\ No newline at end of file
+}
+
+AdcGroup::AdcGroup() : sensor_nb(0), pending(0), completed(0), stamp(0)
+{
+	clear();
+}
+
+uint8_t AdcGroup::add_sensor(AnalogSensor *sensor)
+{
+	if(sensor == NULL || sensor_nb >= ADC_GROUP_SIZE || pending) return 0;
+	sensors[sensor_nb] = sensor;
+	samples[sensor_nb] = 0;
+	sensor_nb++;
+	return 1;
+}
+
+void AdcGroup::clear()
+{
+	if(pending) return;	// The ISR still reads the sensors list
+	for(uint8_t i=0; i<ADC_GROUP_SIZE; i++)
+	{
+		sensors[i] = NULL;
+		samples[i] = 0;
+	}
+	sensor_nb = 0;
+}
+
+uint8_t AdcGroup::get_sensor_nb() {return sensor_nb;}
+AnalogSensor* AdcGroup::get_sensor(uint8_t index) {return sensors[index];}
+uint8_t AdcGroup::is_pending() {return pending;}
+uint16_t AdcGroup::get_stamp() {return stamp;}
+void AdcGroup::set_pending() {pending = 1;}
+void AdcGroup::set_sample(uint8_t index, uint16_t value) {samples[index] = value;}
+void AdcGroup::release() {pending = 0;}
+
+// Single byte flag : the ISR only sets it, a completion which lands between the read and the clear is
+// merged with this one (its samples are in the sensors anyway)
+uint8_t AdcGroup::take_completion()
+{
+	uint8_t state = completed;
+	if(state) completed = 0;
+	return state;
+}
+
+void AdcGroup::deliver(uint16_t n_stamp)
+{
+	for(uint8_t i=0; i<sensor_nb; i++) sensors[i]->set_adc_result(samples[i], n_stamp);
+	stamp = n_stamp;
+	completed = 1;
+	pending = 0;	// The group may be requested again
+}
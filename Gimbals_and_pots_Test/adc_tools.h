@@ -15,10 +15,47 @@
 #if !defined(ADC_HEADER) && defined(SENSORS_HEADER)
 #define ADC_HEADER
 
-#define ADC_REQUEST_SIZE 8
+#ifndef ADC_REQUEST_SIZE
+#define ADC_REQUEST_SIZE 8	// Can be overriden from the compiler command line (-DADC_REQUEST_SIZE=n) to tune the pending list
+#endif
 #define ADC_REQ_LATCH ADC_REQUEST_SIZE/2
+#define ADC_SCAN_SIZE 8	// Maximum number of sensors sampled by the scan mode
+#define ADC_CHANNEL_NB 16	// MUX3:0 -> 16 channels (ADC0..7, temperature, bandgap, GND)
+#define ADC_MAX_OVERSAMPLING 3	// 4^3 = 64 conversions -> 13 bits results, sum still fits in 16 bits
+#ifndef ADC_GROUP_SIZE
+#define ADC_GROUP_SIZE 2	// Sensors converted as one unit by a group request (Gimbal : X and Y)
+#endif
+#ifndef ADC_GROUP_QUEUE
+#define ADC_GROUP_QUEUE 4	// Groups waiting for the Adc (one per Gimbal is enough)
+#endif
+
+// Time stamp given to each sample pushed into its sensor. Defaults to the Adc conversions counter (conversions are
+// 13 ADC clocks long : 104 us with the 128 prescaler when the Adc is kept busy). Can be replaced by a free running timer,
+// e.g. -DADC_TIMESTAMP=TCNT1
+#ifndef ADC_TIMESTAMP
+#define ADC_TIMESTAMP conversion_nb
+#endif
+
+// Build with -DADC_PENDING_BITMAP to replace the pending requests list (ring of sensor pointers) by a per-channel
+// pending bitmap and a FIFO of channel indexes :
+//  -> one pending request per adc channel at most : a sensor which is already pending is not queued twice
+//  -> cancellation and "already pending" checks are O(1), cancelled requests leave no hole for the ISR to spin over
+//  -> the FIFO can't overflow (one entry per channel), so requests are never discarded because the list is full
+
+// Build with -DADC_PRIORITY_SCHEDULER (implies ADC_PENDING_BITMAP) to pick the next conversion among the pending channels
+// by smooth weighted round-robin instead of the FIFO order. Weight of a sensor is its HardwareActuator priority + 1
+// (capped to ADC_MAX_WEIGHT) : when the Adc is saturated, a channel gets its share of conversions in proportion of its weight.
+// Waiting channels earn credits at each pick (aging), so low priority channels are delayed but never starved.
+#ifdef ADC_PRIORITY_SCHEDULER
+#ifndef ADC_PENDING_BITMAP
+#define ADC_PENDING_BITMAP
+#endif
+#define ADC_MAX_WEIGHT 16
+#endif
 
 class AnalogSensor;
+class SensorBank;
+class AdcGroup;
 #include "Sensors.h"
 
 
@@ -33,12 +70,102 @@ public:
 	void purge_requests();
 	uint8_t clear_sensor_requests(AnalogSensor *sensor);
 	void start_conversion();
+	void handle_conversion();	// Body of the ADC_vect ISR (shared by the firmware and the host simulation)
+	uint8_t get_pending_req_nb();	// Number of requests currently stored in the pending list
+	uint8_t is_full();	// Returns 1 while new requests are discarded (list full, until it drains below ADC_REQ_LATCH)
+
+	// Scan mode : the ADC runs in free running mode and the ISR goes round the scan list,
+	// pushing each result directly into its sensor. No request is needed from the main loop.
+	// Scan mode and request mode are exclusive (add_request() is discarded while scanning)
+	uint8_t add_scan_sensor(AnalogSensor *sensor);	// Sensor is sampled on its adc mux, returns 0 if the scan list is full
+	void clear_scan_list();
+	void start_scan();
+	void stop_scan();
+	uint8_t is_scanning();
+
+	// Bank rounds : converts every sensor of a SensorBank once, the ISR chains the channels.
+	// Exclusive with scan mode and requests (refused while requests are pending, add_request() is discarded during a round)
+	uint8_t start_bank_round(SensorBank *bank);
+	uint8_t is_bank_running();
+
+	// Group requests : the sensors of a group are converted back to back, nothing runs in between, and their results are
+	// delivered together with the same time stamp (see AdcGroup). A queued group starts as soon as the running
+	// request ends, ahead of the pending requests, and one pending request runs between two groups (no starvation).
+	// Works with both requests lists (ring and ADC_PENDING_BITMAP).
+	// Returns 0 if the group is empty or already pending, if ADC_GROUP_QUEUE groups are waiting, or while scanning / in a bank round
+	uint8_t add_group_request(AdcGroup *group);
+	uint8_t is_group_running();
 private:
+	void handle_scan_conversion();
+	void handle_bank_conversion();
+	void handle_group_conversion();
+	void start_group();	// Pops the oldest queued group and starts its first conversion
+#ifdef ADC_PENDING_BITMAP
+	int8_t next_channel();	// Next pending channel to convert (-1 if none)
+	AnalogSensor *channel_owner[ADC_CHANNEL_NB];	// Sensor which has requested each channel
+	volatile uint16_t pending_bitmap;	// bit n : channel n waits for a conversion
+#ifdef ADC_PRIORITY_SCHEDULER
+	uint8_t channel_weight[ADC_CHANNEL_NB];	// Priority + 1 of the channel's owner
+	int16_t channel_credit[ADC_CHANNEL_NB];	// Smooth weighted round-robin credits
+#else
+	uint8_t channel_fifo[ADC_CHANNEL_NB];	// Requested channels, oldest first (one entry per channel at most)
+	volatile uint16_t queued_bitmap;	// bit n : channel n has an entry in channel_fifo (its request may have been cancelled)
+	volatile uint8_t fifo_head;
+	volatile uint8_t fifo_count;
+#endif
+	AnalogSensor * volatile current_sensor;	// Sensor whose conversion is running (NULL if idle or cancelled)
+	volatile uint8_t converting;
+	volatile uint8_t tot_req;         // Pending + running requests
+#else
 	AnalogSensor *requests[ADC_REQUEST_SIZE];  // Holds the list of sensors id which have pending requests
 	volatile uint8_t req_iterator;    // Used to store the requests
 	volatile uint8_t processing_iterator; // Used to process each request
 	volatile uint8_t tot_req;         // Total request counter
 	volatile uint8_t req_full_flag;   // Used to know if request list is full
+#endif
+	AnalogSensor *scan_list[ADC_SCAN_SIZE];	// Sensors sampled in scan mode, in scanning order
+	uint8_t scan_nb;	// Number of sensors in the scan list
+	volatile uint8_t scan_current;	// Sensor whose conversion is running
+	volatile uint8_t scan_pending;	// Sensor whose mux is in ADMUX (used by the next conversion)
+	volatile uint8_t scan_mode;
+	volatile uint16_t oversampling_sum;	// Accumulated conversions of the running request
+	volatile uint8_t oversampling_count;
+	volatile uint16_t conversion_nb;	// Conversions handled by the ISR (wraps around)
+	SensorBank * volatile bank;	// Bank whose round is running (NULL otherwise)
+	volatile uint8_t bank_current;
+	AdcGroup *group_queue[ADC_GROUP_QUEUE];	// Groups waiting for the Adc, oldest first
+	volatile uint8_t group_head;
+	volatile uint8_t group_count;
+	AdcGroup * volatile group;	// Group being converted (NULL otherwise)
+	volatile uint8_t group_current;
+};
+
+// Set of sensors converted as one unit (Adc::add_group_request). The ISR keeps the results of the group until its
+// last conversion, then pushes all of them into their sensors with the same time stamp and raises a single
+// completion flag. Group requests don't go through the AdcHandler (no per sensor quota) and are not oversampled.
+class AdcGroup {
+public:
+	AdcGroup();
+	uint8_t add_sensor(AnalogSensor *sensor);	// Sensors are converted in the order they were added, returns 0 if the group is full
+	void clear();
+	uint8_t get_sensor_nb();
+	AnalogSensor* get_sensor(uint8_t index);
+	uint8_t is_pending();	// Queued or being converted : add_group_request() refuses it
+	uint8_t take_completion();	// Returns 1 once per delivered group (main loop side), then clears the flag
+	uint16_t get_stamp();	// Time stamp shared by the samples of the last delivered group
+
+	// Adc side
+	void set_pending();
+	void set_sample(uint8_t index, uint16_t value);
+	void deliver(uint16_t stamp);	// Pushes the samples into the sensors and raises the completion flag
+	void release();	// Dropped by Adc::initialize() : no longer pending, nothing is delivered
+private:
+	AnalogSensor *sensors[ADC_GROUP_SIZE];
+	uint16_t samples[ADC_GROUP_SIZE];
+	uint8_t sensor_nb;
+	volatile uint8_t pending;
+	volatile uint8_t completed;
+	volatile uint16_t stamp;
 };
 
 // Class which is used to handle adc operations of sensors (Gimbals & pots)
@@ -46,6 +173,7 @@ class AdcHandler {
 public:
 	AdcHandler();
 	AdcHandler(uint8_t n_mux , uint8_t max_req);
+	AdcHandler(const AdcHandler& other);	// Copies the settings only : the requests and the scan mode stay with the source
 	
 	void send_adc_request(Adc* adc, AnalogSensor* sensor);
 	void set_max_adc_req_nb(uint8_t nb);
@@ -56,6 +184,13 @@ public:
 	volatile uint8_t get_tot_req_nb();
 	volatile uint8_t get_max_req_nb();
 	volatile uint8_t is_full();
+	void set_scan_mode(uint8_t state);	// Scanned sensors don't send requests anymore
+	uint8_t is_scanned();
+	// Oversampling : each request is converted 4^n times back to back on the same channel and the ISR delivers
+	// one decimated result (sum >> n) on 10 + n bits (ranges of the sensor have to be scaled accordingly).
+	// n is capped to ADC_MAX_OVERSAMPLING, 0 disables it. Not used in scan mode.
+	void set_oversampling(uint8_t n);
+	uint8_t get_oversampling();
 
 	void conversion_complete();	
 private:
@@ -63,6 +198,8 @@ private:
 	volatile uint8_t tot_request_nb; // Stores total request number (currently executed)
 	volatile uint8_t max_request_nb; // Maximum requests number that could be handled by the sensor
 	volatile uint8_t full_flag;	// Used to track if the sensor has sent all of its available requests
+	uint8_t scan_mode;	// Sensor is sampled by the Adc scan mode
+	uint8_t oversampling;	// log4 of the number of conversions per result
 	
 	};
 
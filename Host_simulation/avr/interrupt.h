@@ -0,0 +1,16 @@
+/*
+* Host replacement of <avr/interrupt.h>.
+* ISR(vector) declares the C symbol called by the simulated peripherals (see sim_adc.h)
+* and sei()/cli() drive the simulated global interrupt flag.
+*/
+
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include "../sim_adc.h"
+
+#define ISR(vector, ...) extern "C" void vector(void)
+#define sei() sim_adc.set_global_interrupts(1)
+#define cli() sim_adc.set_global_interrupts(0)
+
+#endif
@@ -0,0 +1,62 @@
+/*
+* Host replacement of <avr/io.h> (Atmega328P subset).
+* Registers are mapped onto the simulated peripherals of sim_adc.h, bit positions are the ones of iom328p.h
+* Add -I<path to Host_simulation> to the compiler flags so that this file is picked instead of avr-libc's one.
+*/
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+#include "../sim_adc.h"
+
+// ADC registers
+#define ADCSRA (sim_adc.adcsra)
+#define ADCSRB (sim_adc.adcsrb)
+#define ADMUX  (sim_adc.admux)
+#define ADCL   (sim_adc.adcl)
+#define ADCH   (sim_adc.adch)
+#define PRR    (sim_adc.prr)
+#define DIDR0  (sim_adc.didr0)
+#define SREG   (sim_adc.sreg)
+
+// SREG bits
+#define SREG_I 7
+
+// ADCSRA bits
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE  3
+#define ADIF  4
+#define ADATE 5
+#define ADSC  6
+#define ADEN  7
+
+// ADCSRB bits
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define ACME  6
+
+// ADMUX bits
+#define MUX0  0
+#define MUX1  1
+#define MUX2  2
+#define MUX3  3
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+
+// PRR bits
+#define PRADC 0
+
+// DIDR0 bits
+#define ADC0D 0
+#define ADC1D 1
+#define ADC2D 2
+#define ADC3D 3
+#define ADC4D 4
+#define ADC5D 5
+
+#endif
@@ -0,0 +1,21 @@
+/*
+* Host replacement of <avr/pgmspace.h>.
+* There is a single address space on the host : PROGMEM data stays where the compiler puts it
+* and pgm_read_xxx() are plain memory reads.
+*/
+
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
+
+#endif
@@ -0,0 +1,210 @@
+
+#include "sim_adc.h"
+#include "avr/io.h"
+#include <time.h>
+
+SimAdc sim_adc;	// The one and only simulated ADC (registers are mapped on it by avr/io.h)
+
+/************************************************************************/
+/* SimRegister implementation                                           */
+/************************************************************************/
+
+SimRegister::SimRegister(SimAdc* n_owner, uint8_t reset_value) : owner(n_owner), value(reset_value) {}
+SimRegister::operator uint8_t() const {return value;}
+uint8_t SimRegister::peek() const {return value;}
+void SimRegister::poke(uint8_t n_value) {value = n_value;}
+
+SimRegister& SimRegister::operator=(uint8_t n_value)
+{
+	uint8_t old_value = value;
+	value = n_value;
+	if(owner != NULL) owner->register_written(this, old_value);
+	return *this;
+}
+SimRegister& SimRegister::operator|=(uint8_t n_value) {return *this = (uint8_t)(value | n_value);}
+SimRegister& SimRegister::operator&=(uint8_t n_value) {return *this = (uint8_t)(value & n_value);}
+SimRegister& SimRegister::operator^=(uint8_t n_value) {return *this = (uint8_t)(value ^ n_value);}
+
+
+/************************************************************************/
+/* SimAdc implementation                                                */
+/************************************************************************/
+
+SimAdc::SimAdc() : adcsra(this), adcsrb(this), admux(this), adcl(this), adch(this), prr(this), didr0(this), sreg(this),
+				   isr_cycles(0), input_source(NULL)
+{
+	for(uint8_t i = 0; i < SIM_ADC_CHANNELS; i++) inputs[i] = 0;
+	reset();
+}
+
+void SimAdc::reset()
+{
+	adcsra.poke(0); adcsrb.poke(0); admux.poke(0);
+	adcl.poke(0); adch.poke(0); prr.poke(0); didr0.poke(0); sreg.poke(0);
+	cycles = 0;
+	target_cycles = 0;
+	conversion_start = 0;
+	conversion_end = 0;
+	busy_cycles = 0;
+	conversion_nb = 0;
+	isr_nb = 0;
+	sampled_value = 0;
+	converting = 0;
+	first_conversion = 1;
+	global_interrupts = 0;
+	in_isr = 0;
+}
+
+void SimAdc::set_input(uint8_t channel, uint16_t value)
+{
+	if(channel < SIM_ADC_CHANNELS) inputs[channel] = value & 0x3FF;	// 10 bits converter
+}
+void SimAdc::set_input_source(SimInputSource source) {input_source = source;}
+void SimAdc::set_isr_cycles(uint16_t n_cycles) {isr_cycles = n_cycles;}
+uint8_t SimAdc::get_global_interrupts() {return global_interrupts;}
+uint64_t SimAdc::get_cycles() {return cycles;}
+uint32_t SimAdc::get_conversion_nb() {return conversion_nb;}
+uint32_t SimAdc::get_isr_nb() {return isr_nb;}
+uint64_t SimAdc::get_busy_cycles() {return busy_cycles + (converting ? cycles - conversion_start : 0);}
+double SimAdc::cycles_to_seconds(uint64_t n_cycles) {return (double) n_cycles / F_CPU;}
+
+void SimAdc::set_global_interrupts(uint8_t state)
+{
+	global_interrupts = state;
+	sreg.poke(state ? (sreg.peek() | (1<<SREG_I)) : (sreg.peek() & ~(1<<SREG_I)));
+	if(state) dispatch_interrupts();	// A pending ADIF is serviced as soon as interrupts are enabled again
+}
+
+// ADPS2:0 -> 2, 2, 4, 8, 16, 32, 64, 128
+uint16_t SimAdc::get_prescaler()
+{
+	uint8_t adps = adcsra.peek() & 0x07;
+	return adps == 0 ? 2 : (1 << adps);
+}
+
+// ADC is only clocked when enabled and not shut down by the power reduction register
+uint8_t SimAdc::is_powered()
+{
+	return (adcsra.peek() & (1<<ADEN)) && !(prr.peek() & (1<<PRADC));
+}
+
+// Emulates what the hardware does when the firmware writes into one of the ADC registers
+void SimAdc::register_written(SimRegister* reg, uint8_t old_value)
+{
+	if(reg == &adcsra)
+	{
+		uint8_t written = adcsra.peek();
+		uint8_t n_value = written & ~((1<<ADSC) | (1<<ADIF));
+		// ADIF is cleared by writing a logical one to it (beware of read-modify-write instructions!)
+		if((old_value & (1<<ADIF)) && !(written & (1<<ADIF))) n_value |= (1<<ADIF);
+		adcsra.poke(n_value);
+		if(!(n_value & (1<<ADEN)))
+		{
+			// Switching the ADC off aborts the ongoing conversion
+			if(converting) busy_cycles += cycles - conversion_start;
+			converting = 0;
+			first_conversion = 1;
+		}
+		else if((written & (1<<ADSC)) && !converting && is_powered()) start_conversion();
+		if(converting) adcsra.poke(adcsra.peek() | (1<<ADSC));	// ADSC reads as one as long as a conversion is in progress
+	}
+	else if(reg == &sreg)
+	{
+		global_interrupts = (sreg.peek() >> SREG_I) & 1;	// Restoring SREG re-enables interrupts if they were enabled
+	}
+	else if(reg == &adcl || reg == &adch)
+	{
+		reg->poke(old_value);	// Read only registers
+	}
+	else if(reg == &prr)
+	{
+		if((prr.peek() & (1<<PRADC)) && converting)
+		{
+			busy_cycles += cycles - conversion_start;
+			converting = 0;
+			adcsra.poke(adcsra.peek() & ~(1<<ADSC));
+		}
+	}
+	dispatch_interrupts();
+}
+
+// Starts a conversion at the current cycle : the channel is latched and the input is sampled
+void SimAdc::start_conversion()
+{
+	uint8_t channel = admux.peek() & 0x0F;
+	uint16_t adc_cycles = first_conversion ? 25 : 13;	// Extended first conversion initializes the analog circuitry
+	sampled_value = input_source != NULL ? (input_source(channel, cycles) & 0x3FF) : inputs[channel];
+	conversion_start = cycles;
+	conversion_end = cycles + (uint64_t) adc_cycles * get_prescaler();
+	converting = 1;
+	first_conversion = 0;
+}
+
+// End of conversion : result registers are updated, ADSC is cleared and ADIF is raised
+void SimAdc::finish_conversion()
+{
+	uint16_t result = sampled_value;
+	if(admux.peek() & (1<<ADLAR)) result <<= 6;	// Left adjusted result
+	adcl.poke(result & 0xFF);
+	adch.poke(result >> 8);
+	busy_cycles += conversion_end - conversion_start;
+	conversion_nb++;
+	converting = 0;
+	adcsra.poke((adcsra.peek() & ~(1<<ADSC)) | (1<<ADIF));
+
+	// Free running mode (ADATE set and ADTS2:0 = 0) : next conversion starts right away
+	if((adcsra.peek() & (1<<ADATE)) && (adcsrb.peek() & 0x07) == 0 && is_powered())
+	{
+		start_conversion();
+		adcsra.poke(adcsra.peek() | (1<<ADSC));
+	}
+}
+
+// Runs the ADC_vect ISR while its flag is pending and interrupts are allowed
+// The ISR cost is stolen from the main loop (target_cycles is pushed back accordingly)
+void SimAdc::dispatch_interrupts()
+{
+	while(!in_isr && global_interrupts && (adcsra.peek() & (1<<ADIE)) && (adcsra.peek() & (1<<ADIF)))
+	{
+		in_isr = 1;
+		global_interrupts = 0;	// I bit is cleared by hardware when entering the vector
+		sreg.poke(sreg.peek() & ~(1<<SREG_I));
+		adcsra.poke(adcsra.peek() & ~(1<<ADIF));	// ADIF is cleared by hardware when executing the vector
+		cycles += isr_cycles;
+		target_cycles += isr_cycles;
+		isr_nb++;
+		if(ADC_vect) ADC_vect();
+		global_interrupts = 1;	// reti
+		sreg.poke(sreg.peek() | (1<<SREG_I));
+		in_isr = 0;
+		// A conversion which has completed during the ISR is handled right after (one instruction of main is executed on real hw)
+		if(converting && conversion_end <= cycles) finish_conversion();
+	}
+}
+
+void SimAdc::run(uint32_t cpu_cycles)
+{
+	target_cycles = cycles + cpu_cycles;
+	while(converting && conversion_end <= target_cycles)
+	{
+		if(conversion_end > cycles) cycles = conversion_end;
+		finish_conversion();
+		dispatch_interrupts();
+	}
+	if(cycles < target_cycles) cycles = target_cycles;
+}
+
+/************************************************************************/
+/* Host tick counter                                                    */
+/************************************************************************/
+
+uint64_t sim_host_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
@@ -0,0 +1,117 @@
+/*
+* Host-side simulation of the Atmega328P ADC peripheral.
+* The registers used by adc_tools and the ADC_vect ISR (ADCSRA, ADCSRB, ADMUX, ADCL, ADCH, PRR, DIDR0, SREG)
+* are mapped onto SimRegister objects (see avr/io.h in this folder), so that the firmware sources
+* compile and run unmodified on a Linux box.
+*
+* The simulated ADC is driven by a cpu cycle counter which is advanced by the host program (SimAdc::run()).
+* It models :
+*  -> ADSC / ADEN / ADIF / ADIE / ADATE behaviors and the PRADC power reduction bit
+*  -> 13 ADC clock cycles per conversion (25 for the first one after ADEN is set) at the configured prescaler
+*  -> channel latching at the start of the conversion (free running mode starts the next conversion
+*     with the ADMUX value available at the end of the previous one, like the real chip does)
+*  -> ADC_vect dispatching when ADIF && ADIE && global interrupts are enabled (sei()/cli() or SREG I bit)
+*
+* Author : bebenlebricolo
+*
+* Version |   date   |  description
+*  V 0.1   17/10/2026  First version : used to measure adc_tools throughput on a dev box
+*
+*/
+
+#ifndef SIM_ADC_HEADER
+#define SIM_ADC_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL	// Simulated cpu clock (Atmega328P on Arduino nano / uno boards)
+#endif
+
+#define SIM_ADC_CHANNELS 16	// MUX3:0 -> 16 possible channels (ADC0..7, temperature, 1.1V bandgap, GND)
+
+// Interrupt vector called by the simulation. Firmware sources declare it with ISR(ADC_vect),
+// which expands to this very symbol on the host (see avr/interrupt.h)
+extern "C" void ADC_vect(void) __attribute__((weak));
+
+class SimAdc;
+
+// 8 bits register which notifies its owner whenever the firmware writes into it
+class SimRegister {
+public:
+	SimRegister(SimAdc* n_owner, uint8_t reset_value = 0);
+	operator uint8_t() const;
+	SimRegister& operator=(uint8_t value);
+	SimRegister& operator|=(uint8_t value);
+	SimRegister& operator&=(uint8_t value);
+	SimRegister& operator^=(uint8_t value);
+	uint8_t peek() const;		// Reads the register without side effects
+	void poke(uint8_t value);	// Writes the register from the hardware side (no write hook)
+private:
+	SimRegister(const SimRegister&);
+	SimAdc* owner;
+	uint8_t value;
+};
+
+// Returns the analog value (0..1023) seen on a given channel at a given cpu cycle
+typedef uint16_t (*SimInputSource)(uint8_t channel, uint64_t cycle);
+
+class SimAdc {
+public:
+	SimAdc();
+	void reset();	// Power-on reset : registers, clock and statistics
+	void run(uint32_t cpu_cycles);	// Lets the main loop spend cpu_cycles (conversions and ISR are processed meanwhile)
+	void set_input(uint8_t channel, uint16_t value);	// Constant input voltage on a channel
+	void set_input_source(SimInputSource source);	// Time varying inputs (overrides set_input() values)
+	void set_isr_cycles(uint16_t cycles);	// Cost of one ISR call (entry + body + reti), stolen from the main loop
+	void set_global_interrupts(uint8_t state);	// sei() / cli()
+	uint8_t get_global_interrupts();
+
+	uint64_t get_cycles();			// Simulated time (cpu cycles since reset)
+	uint32_t get_conversion_nb();	// Conversions completed since reset
+	uint32_t get_isr_nb();			// ISR calls since reset
+	uint64_t get_busy_cycles();		// Cycles during which the ADC was converting
+	uint16_t get_prescaler();		// Prescaler currently set by ADPS2:0
+	double cycles_to_seconds(uint64_t cycles);
+
+	void register_written(SimRegister* reg, uint8_t old_value);	// Write hook called by SimRegister
+
+	SimRegister adcsra;
+	SimRegister adcsrb;
+	SimRegister admux;
+	SimRegister adcl;
+	SimRegister adch;
+	SimRegister prr;
+	SimRegister didr0;
+	SimRegister sreg;	// Only the I bit is simulated (saved / restored around critical sections)
+private:
+	uint8_t is_powered();
+	void start_conversion();
+	void finish_conversion();
+	void dispatch_interrupts();
+
+	uint64_t cycles;
+	uint64_t target_cycles;		// End of the current run() call
+	uint64_t conversion_start;
+	uint64_t conversion_end;
+	uint64_t busy_cycles;
+	uint32_t conversion_nb;
+	uint32_t isr_nb;
+	uint16_t isr_cycles;
+	uint16_t sampled_value;		// Value held by the sample and hold circuit
+	uint16_t inputs[SIM_ADC_CHANNELS];
+	SimInputSource input_source;
+	uint8_t converting;
+	uint8_t first_conversion;	// Next conversion is the first one after enabling the ADC (25 ADC cycles)
+	uint8_t global_interrupts;	// SREG I bit
+	uint8_t in_isr;
+};
+
+extern SimAdc sim_adc;
+
+// Host monotonic tick counter (time stamp counter on x86, nanoseconds elsewhere)
+// Used to time host code such as TransformPipeline::transform
+uint64_t sim_host_ticks();
+
+#endif